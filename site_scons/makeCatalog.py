@@ -0,0 +1,136 @@
+# OSARA: Open Source Accessibility for the REAPER Application
+# Utility to compile a translation (po) file into a binary catalog
+# Copyright 2024 James Teh
+# License: GNU General Public License version 2.0
+
+# The catalog is read by TranslationCatalog in src/translation.cpp, so the
+# format must be kept in sync with that. All integers are 32 bit little
+# endian. The file consists of:
+# 1. A header: magic ("OSRC"), version, entry count, bucket count and the
+# offset of the Plural-Forms expression.
+# 2. The hash buckets: bucket count entries, each being an entry index + 1 or
+# 0 if the bucket is empty. Collisions are resolved by linear probing.
+# 3. The entries: hash, key offset, key length, value offset, value length.
+# A key is the msgid, prefixed by the context and "\x04" if there is a
+# context. A value is the translation. For plurals, this is each form
+# separated by "\0". Values are followed by an extra "\0" so that the end of
+# the forms can be found without the length.
+# 4. The strings. Every key and value is followed by "\0", so they can be used
+# directly as C strings.
+# All offsets are from the start of the file.
+
+import struct
+
+MAGIC = b"OSRC"
+VERSION = 1
+HEADER_FORMAT = "<4sIIII"
+ENTRY_FORMAT = "<IIIII"
+
+def hashKey(key):
+	# 32 bit FNV-1a.
+	h = 2166136261
+	for b in key:
+		h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+	return h
+
+def unescape(s):
+	out = []
+	i = 0
+	while i < len(s):
+		c = s[i]
+		if c == "\\" and i + 1 < len(s):
+			i += 1
+			c = s[i]
+			out.append({"n": "\n", "t": "\t", "r": "\r"}.get(c, c))
+		else:
+			out.append(c)
+		i += 1
+	return "".join(out)
+
+def parsePo(input):
+	"""Yields (context, msgid, [msgstr, ...]) for each message.
+	"""
+	entry = {}
+	# The field which a continuation string (a line which is just a string) is
+	# appended to.
+	field = None
+	def finish():
+		if "msgid" in entry:
+			forms = [entry[k] for k in sorted(entry) if k.startswith("msgstr")]
+			return (entry.get("msgctxt"), entry["msgid"], forms)
+		return None
+	for line in input:
+		line = line.strip()
+		if not line or line.startswith("#"):
+			continue
+		if line.startswith('"'):
+			if field:
+				entry[field] += unescape(line[1:-1])
+			continue
+		keyword, value = line.split(None, 1)
+		if (keyword in ("msgctxt", "msgid") and
+				any(k.startswith("msgstr") for k in entry)):
+			# This starts a new message.
+			result = finish()
+			if result:
+				yield result
+			entry = {}
+		if keyword.startswith("msgstr["):
+			# Pad the form number so that sorting keeps forms in order.
+			keyword = "msgstr[%03d]" % int(keyword[7:-1])
+		field = keyword
+		entry[field] = unescape(value[1:-1])
+	result = finish()
+	if result:
+		yield result
+
+def makeCatalog(target, source, env):
+	pluralForms = ""
+	messages = []
+	with open(source[0].path, "rt", encoding="UTF-8") as input:
+		for context, msgid, forms in parsePo(input):
+			if not msgid:
+				# This is the header.
+				for line in forms[0].splitlines():
+					if line.startswith("Plural-Forms:"):
+						pluralForms = line.split(":", 1)[1].strip()
+				continue
+			if not all(forms):
+				# Untranslated.
+				continue
+			key = msgid
+			if context:
+				key = context + "\x04" + msgid
+			messages.append((key.encode("UTF-8"),
+				("\0".join(forms) + "\0").encode("UTF-8")))
+	bucketCount = 1
+	while bucketCount < len(messages) * 2:
+		bucketCount *= 2
+	headerSize = struct.calcsize(HEADER_FORMAT)
+	entrySize = struct.calcsize(ENTRY_FORMAT)
+	stringsOffset = headerSize + bucketCount * 4 + len(messages) * entrySize
+	strings = bytearray()
+	def addString(s):
+		offset = stringsOffset + len(strings)
+		strings.extend(s)
+		strings.append(0)
+		return offset
+	pluralFormsOffset = addString(pluralForms.encode("UTF-8"))
+	buckets = [0] * bucketCount
+	entries = bytearray()
+	for index, (key, value) in enumerate(messages):
+		h = hashKey(key)
+		b = h & (bucketCount - 1)
+		while buckets[b]:
+			b = (b + 1) & (bucketCount - 1)
+		buckets[b] = index + 1
+		keyOffset = addString(key)
+		valueOffset = addString(value)
+		entries.extend(struct.pack(ENTRY_FORMAT, h, keyOffset, len(key),
+			valueOffset, len(value)))
+	with open(target[0].path, "wb") as out:
+		out.write(struct.pack(HEADER_FORMAT, MAGIC, VERSION, len(messages),
+			bucketCount, pluralFormsOffset))
+		out.write(struct.pack("<%dI" % bucketCount, *buckets))
+		out.write(entries)
+		out.write(strings)
@@ -8,14 +8,20 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <array>
 #include <map>
+#include <vector>
 #include <WDL/db2val.h>
 #include <cstdint>
 #include "osara.h"
 #include "config.h"
 #include "fxChain.h"
+#include "fxTree.h"
 #include "paramsUi.h"
+#include "peakWatcher.h"
+#include "perfTrace.h"
 #include "midiEditorCommands.h"
+#include "timeline.h"
 #include "translation.h"
 
 using namespace std;
@@ -65,6 +71,213 @@ class TrackCacheState {
 	uint8_t& value;
 };
 
+// The cached states for all tracks, keyed by track. REAPER notifies us about
+// every track at once in some cases (e.g. loading a project or unsoloing all
+// tracks), so this is an open addressing hash table in a single array rather
+// than a node based map.
+class TrackCacheTable {
+	public:
+	// Get the cached states for a track, adding it if necessary. The reference
+	// is only valid until the next call.
+	uint8_t& operator[](MediaTrack* track) {
+		if ((this->count + 1) * 2 > this->slots.size()) {
+			this->grow();
+		}
+		Slot& slot = this->find(track);
+		if (!slot.track) {
+			slot.track = track;
+			slot.value = 0;
+			++this->count;
+		}
+		return slot.value;
+	}
+
+	void clear() {
+		this->slots.assign(this->slots.size(), Slot());
+		this->count = 0;
+	}
+
+	private:
+	struct Slot {
+		MediaTrack* track = nullptr;
+		uint8_t value = 0;
+	};
+
+	Slot& find(MediaTrack* track) {
+		const size_t mask = this->slots.size() - 1;
+		// Fibonacci hashing, since pointers are aligned and thus their low bits are
+		// all the same.
+		size_t index = (size_t)(((uint64_t)(uintptr_t)track *
+			0x9E3779B97F4A7C15ull) >> 32) & mask;
+		while (this->slots[index].track && this->slots[index].track != track) {
+			index = (index + 1) & mask;
+		}
+		return this->slots[index];
+	}
+
+	void grow() {
+		vector<Slot> old = std::move(this->slots);
+		this->slots.assign(old.empty() ? 64 : old.size() * 2, Slot());
+		for (const Slot& slot: old) {
+			if (slot.track) {
+				this->find(slot.track) = slot;
+			}
+		}
+	}
+
+	vector<Slot> slots;
+	size_t count = 0;
+};
+
+// Reads MIDI input events received since the last read. REAPER only lets us
+// query recent events by age, so several notes played between two polls (e.g.
+// a chord) would be missed if we only fetched the most recent one.
+class MidiInputReader {
+	public:
+	struct Event {
+		unsigned char status;
+		unsigned char data1;
+		unsigned char data2;
+	};
+
+	// Fetch all events received since the last call into the buffer, oldest
+	// first. If more events arrived than the buffer can hold, the oldest are
+	// dropped.
+	void drain() {
+		// Index 0 is the most recent event. Walk back until we reach the last
+		// event we saw.
+		array<Event, CAPACITY> fetched;
+		size_t fetchedCount = 0;
+		int newest = 0;
+		for (int age = 0; age < (int)CAPACITY; ++age) {
+			unsigned char event[3] = {0};
+			int eventSize = sizeof(event);
+			int seq = MIDI_GetRecentInputEvent(age, (char*)event, &eventSize,
+				nullptr, nullptr, nullptr, nullptr);
+			if (seq == 0 || seq == this->lastSeq) {
+				break; // No more events or already seen.
+			}
+			if (age == 0) {
+				newest = seq;
+			}
+			if (eventSize == sizeof(event)) {
+				fetched[fetchedCount++] = {event[0], event[1], event[2]};
+			}
+		}
+		if (!this->started) {
+			// These events happened before we started reading, so we shouldn't
+			// report them.
+			this->started = true;
+			this->lastSeq = newest;
+			return;
+		}
+		if (newest == 0) {
+			return;
+		}
+		this->lastSeq = newest;
+		// Events were fetched newest first.
+		while (fetchedCount > 0) {
+			this->push(fetched[--fetchedCount]);
+		}
+	}
+
+	bool pop(Event& event) {
+		if (this->count == 0) {
+			return false;
+		}
+		event = this->events[this->head];
+		this->head = (this->head + 1) % CAPACITY;
+		--this->count;
+		return true;
+	}
+
+	void clear() {
+		this->head = 0;
+		this->count = 0;
+	}
+
+	// Stop reading. The next drain() will skip events received until then.
+	void reset() {
+		this->clear();
+		this->started = false;
+	}
+
+	private:
+	void push(const Event& event) {
+		if (this->count == CAPACITY) {
+			// Drop the oldest.
+			this->head = (this->head + 1) % CAPACITY;
+			--this->count;
+		}
+		this->events[(this->head + this->count) % CAPACITY] = event;
+		++this->count;
+	}
+
+	static constexpr size_t CAPACITY = 64;
+	array<Event, CAPACITY> events;
+	size_t head = 0;
+	size_t count = 0;
+	int lastSeq = 0;
+	bool started = false;
+};
+
+// Caches note names for a track, with a table for each channel. Fetching a
+// name involves several REAPER calls and string formatting, which is wasteful
+// when the same notes are played over and over.
+class MidiNoteNameTable {
+	public:
+	// Prepare to fetch names for a track and channel. This must be called before
+	// get() for each batch of notes.
+	void select(MediaTrack* track, int channel) {
+		int stateCount = GetProjectStateChangeCount(nullptr);
+		bool showNames = GetToggleCommandState2(
+			SectionFromUniqueID(MIDI_EDITOR_SECTION), 40045); // View: Show note names
+		int size = 0;
+		int* octaveOffsetVar = (int*)get_config_var("midioctoffs", &size);
+		int octaveOffset = octaveOffsetVar && size == sizeof(int) ?
+			*octaveOffsetVar : 0;
+		if (track != this->track || stateCount != this->stateCount ||
+				showNames != this->showNames || octaveOffset != this->octaveOffset ||
+				translationGeneration != this->generation) {
+			for (auto& channelNames: this->names) {
+				for (auto& name: channelNames) {
+					name.hasName = false;
+				}
+			}
+			this->track = track;
+			this->stateCount = stateCount;
+			this->showNames = showNames;
+			this->octaveOffset = octaveOffset;
+			this->generation = translationGeneration;
+		}
+		this->channel = channel & 0xF;
+	}
+
+	const string& get(int pitch) {
+		CachedName& name = this->names[this->channel][pitch & 0x7F];
+		if (!name.hasName) {
+			name.name = getMidiNoteName(this->track, pitch & 0x7F, this->channel);
+			// The name might be empty, so this is tracked separately.
+			name.hasName = true;
+		}
+		return name.name;
+	}
+
+	private:
+	struct CachedName {
+		bool hasName = false;
+		string name;
+	};
+
+	MediaTrack* track = nullptr;
+	int channel = 0;
+	int stateCount = -1;
+	bool showNames = false;
+	int octaveOffset = 0;
+	int generation = -1;
+	array<array<CachedName, 128>, 16> names;
+};
+
 /*** A control surface to obtain certain info that can only be retrieved that way.
  */
 class Surface: public IReaperControlSurface {
@@ -82,6 +295,10 @@ class Surface: public IReaperControlSurface {
 	}
 
 	void Run() final {
+		perfTrace::ScopedTimer timer(perfTrace::SITE_SURFACE_RUN);
+		this->reportPendingStateChanges();
+		peakWatcher::onControlSurfaceRun();
+		flushOutputQueue();
 		if (GetPlayState() & 1) {
 			double playPos = GetPlayPosition();
 			if (playPos == this->lastPlayPos) {
@@ -89,6 +306,7 @@ class Surface: public IReaperControlSurface {
 			}
 			this->lastPlayPos = playPos;
 			if (settings::reportMarkersWhilePlaying) {
+				this->timeline.update();
 				this->reportMarker(playPos);
 			}
 			if (settings::reportTimeSelectionWhilePlaying) {
@@ -121,49 +339,50 @@ class Surface: public IReaperControlSurface {
 		if (isParamsDialogOpen || !this->shouldHandleParamChange()) {
 			return;
 		}
-		ostringstream s;
-		bool different = this->reportTrackIfDifferent(track, s);
+		ostringstream context;
+		bool different = this->reportTrackIfDifferent(track, context);
 		different |= this->lastParam != PARAM_VOLUME;
 		if (different) {
-			s << translate("volume") << " ";
+			context << translate("volume") << " ";
 			this->lastParam = PARAM_VOLUME;
 		}
+		ostringstream s;
 		s << fixed << setprecision(2);
 		s << VAL2DB(volume);
-		outputMessage(s);
+		queueMessage(OUTPUT_SURFACE_VOLUME, s.str(), true, context.str());
 	}
 
 	void SetSurfacePan(MediaTrack* track, double pan) final {
 		if (isParamsDialogOpen || !this->shouldHandleParamChange()) {
 			return;
 		}
-		ostringstream s;
-		bool different = this->reportTrackIfDifferent(track, s);
+		ostringstream context;
+		bool different = this->reportTrackIfDifferent(track, context);
 		different |= this->lastParam != PARAM_PAN;
 		if (different) {
-			s << translate("pan") << " ";
+			context << translate("pan") << " ";
 			this->lastParam = PARAM_PAN;
 		}
+		ostringstream s;
 		formatPan(pan, s);
-		outputMessage(s);
+		queueMessage(OUTPUT_SURFACE_PAN, s.str(), true, context.str());
 	}
 
 	void SetSurfaceMute(MediaTrack* track, bool mute) final {
+		invalidateTrackStateSnapshot();
 		if (!settings::reportSurfaceChanges) {
 			return;
 		}
 		auto cache = this->cachedTrackState<TC_MUTED, TC_UNMUTED>(track);
 		if (!isParamsDialogOpen && !this->wasCausedByCommand() &&
 				cache.hasChanged(mute)) {
-			ostringstream s;
-			this->reportTrackIfDifferent(track, s);
-			s << (mute ? translate("muted") : translate("unmuted"));
-			outputMessage(s);
+			this->addPendingStateChange(track, mute ? TC_MUTED : TC_UNMUTED);
 		}
 		cache.update(mute);
 	}
 
 	void SetSurfaceSolo(MediaTrack* track, bool solo) final {
+		invalidateTrackStateSnapshot();
 		if (!settings::reportSurfaceChanges) {
 			return;
 		}
@@ -175,25 +394,20 @@ class Surface: public IReaperControlSurface {
 		auto cache = this->cachedTrackState<TC_SOLOED, TC_UNSOLOED>(track);
 		if (!isParamsDialogOpen && !this->wasCausedByCommand() &&
 				cache.hasChanged(solo)) {
-			ostringstream s;
-			this->reportTrackIfDifferent(track, s);
-			s << (solo ? translate("soloed") : translate("unsoloed"));
-			outputMessage(s);
+			this->addPendingStateChange(track, solo ? TC_SOLOED : TC_UNSOLOED);
 		}
 		cache.update(solo);
 	}
 
 	void SetSurfaceRecArm(MediaTrack* track, bool arm) final {
+		invalidateTrackStateSnapshot();
 		if (!settings::reportSurfaceChanges) {
 			return;
 		}
 		auto cache = this->cachedTrackState<TC_ARMED, TC_UNARMED>(track);
 		if (!isParamsDialogOpen && !this->wasCausedByCommand() &&
 				cache.hasChanged(arm)) {
-			ostringstream s;
-			this->reportTrackIfDifferent(track, s);
-			s << (arm ? translate("armed") : translate("unarmed"));
-			outputMessage(s);
+			this->addPendingStateChange(track, arm ? TC_ARMED : TC_UNARMED);
 		}
 		cache.update(arm);
 		// REAPER calls SetSurfaceVolume after arming a track. Ensure we don't
@@ -202,6 +416,9 @@ class Surface: public IReaperControlSurface {
 	}
 
 	void SetSurfaceSelected(MediaTrack* track, bool selected) final {
+		// Selection changes don't necessarily change the project state change
+		// count.
+		invalidateTrackStateSnapshot();
 		if (!selected || !settings::reportSurfaceChanges ||
 			// REAPER calls this a *lot*, even if the track was already selected; e.g.
 			// for mute, arm, solo, etc. Ignore this if we were already told about
@@ -259,11 +476,17 @@ class Surface: public IReaperControlSurface {
 				s << normVal;
 			}
 			outputMessage(s);
+		} else if (call == CSURF_EXT_SETFXCHANGE) {
+			invalidateFxParamsCache();
+			invalidateFxTrees();
+		} else if (call == CSURF_EXT_SETFXENABLED) {
+			invalidateFxTrees();
 		}
 		return 0; // Unsupported.
 	}
 
 	void SetTrackListChange() final {
+		invalidateTrackStateSnapshot();
 #ifdef _WIN32
 		// hack: A bug in earlier versions of JUCE breaks OSARA UIA events when
 		// a JUCE plugin is removed, which can happen when a track is removed. Hiding
@@ -317,40 +540,144 @@ class Surface: public IReaperControlSurface {
 
 	template<uint8_t enableFlag, uint8_t disableFlag>
 	TrackCacheState<enableFlag, disableFlag> cachedTrackState(MediaTrack* track) {
+		ReaProject* project = EnumProjects(-1, nullptr, 0);
+		if (project != this->trackCacheProject) {
+			// Tracks in other projects are irrelevant now.
+			this->trackCache.clear();
+			this->trackCacheProject = project;
+		}
 		uint8_t& value = this->trackCache[track];
 		return TrackCacheState<enableFlag, disableFlag>(value);
 	}
 
+	// State changes are collected and reported on the next Run(). That way, if
+	// REAPER tells us about many tracks at once (e.g. unsoloing all tracks), we
+	// can report a summary instead of every track.
+	struct PendingStateChange {
+		MediaTrack* track;
+		// One of the TC_* flags indicating the new state.
+		uint8_t state;
+	};
+
+	void addPendingStateChange(MediaTrack* track, uint8_t state) {
+		this->pendingStateChanges.push_back({track, state});
+	}
+
+	void reportPendingStateChanges() {
+		// A track might have been removed since it changed.
+		erase_if(this->pendingStateChanges, [](const auto& change) {
+			return !ValidatePtr((void*)change.track, "MediaTrack*");
+		});
+		if (this->pendingStateChanges.empty()) {
+			return;
+		}
+		ostringstream s;
+		// Report each state in the order it first changed.
+		uint8_t reportedStates = 0;
+		for (const auto& change: this->pendingStateChanges) {
+			if (reportedStates & change.state) {
+				continue;
+			}
+			reportedStates |= change.state;
+			int count = 0;
+			for (const auto& other: this->pendingStateChanges) {
+				if (other.state == change.state) {
+					++count;
+				}
+			}
+			if (s.tellp() > 0) {
+				s << ", ";
+			}
+			if (count == 1) {
+				this->reportTrackIfDifferent(change.track, s);
+				s << translate(getStateName(change.state));
+			} else {
+				s << format(getStateSummary(change.state, count), count);
+				// We've reported several tracks, so report the track name next time.
+				this->lastChangedTrack = nullptr;
+			}
+		}
+		this->pendingStateChanges.clear();
+		outputMessage(s);
+	}
+
+	static const char* getStateName(uint8_t state) {
+		switch (state) {
+			case TC_MUTED:
+				return _t("muted");
+			case TC_UNMUTED:
+				return _t("unmuted");
+			case TC_SOLOED:
+				return _t("soloed");
+			case TC_UNSOLOED:
+				return _t("unsoloed");
+			case TC_ARMED:
+				return _t("armed");
+			default:
+				return _t("unarmed");
+		}
+	}
+
+	static const char* getStateSummary(uint8_t state, int count) {
+		switch (state) {
+			case TC_MUTED:
+				// Translators: Reported when several tracks are muted at once. {} will
+				// be replaced with the number of tracks; e.g. "3 tracks muted".
+				return translate_plural("{} track muted", "{} tracks muted", count);
+			case TC_UNMUTED:
+				// Translators: Reported when several tracks are unmuted at once. {}
+				// will be replaced with the number of tracks; e.g. "3 tracks unmuted".
+				return translate_plural("{} track unmuted", "{} tracks unmuted", count);
+			case TC_SOLOED:
+				// Translators: Reported when several tracks are soloed at once. {} will
+				// be replaced with the number of tracks; e.g. "3 tracks soloed".
+				return translate_plural("{} track soloed", "{} tracks soloed", count);
+			case TC_UNSOLOED:
+				// Translators: Reported when several tracks are unsoloed at once. {}
+				// will be replaced with the number of tracks; e.g. "3 tracks
+				// unsoloed".
+				return translate_plural("{} track unsoloed", "{} tracks unsoloed",
+					count);
+			case TC_ARMED:
+				// Translators: Reported when several tracks are armed at once. {} will
+				// be replaced with the number of tracks; e.g. "3 tracks armed".
+				return translate_plural("{} track armed", "{} tracks armed", count);
+			default:
+				// Translators: Reported when several tracks are unarmed at once. {}
+				// will be replaced with the number of tracks; e.g. "3 tracks unarmed".
+				return translate_plural("{} track unarmed", "{} tracks unarmed", count);
+		}
+	}
+
 	void reportMarker(double playPos) {
-		int marker, region;
-		double markerPos;
-		GetLastMarkerAndCurRegion(0, playPos, &marker, &region);
-		const char* name;
-		int number;
+		this->timeline.seek(playPos);
+		const MarkerTimeline::Entry* markerEntry = this->timeline.getLastMarker();
+		const MarkerTimeline::Entry* regionEntry =
+			this->timeline.getCurrentRegion();
+		int marker = markerEntry ? markerEntry->index : -1;
+		int region = regionEntry ? regionEntry->index : -1;
 		ostringstream s;
 		if (marker >= 0 && marker != this->lastMarker) {
-			EnumProjectMarkers(marker, nullptr, &markerPos, nullptr, &name, &number);
 			// Allow the cursor to be within 100ms, since this method is called
 			// periodically.
-			if (markerPos >= playPos - 0.1) {
-				if (name[0]) {
-					s << format(translate("{} marker"), name) << " ";
+			if (markerEntry->start >= playPos - 0.1) {
+				if (!markerEntry->name.empty()) {
+					s << format(translate("{} marker"), markerEntry->name) << " ";
 				} else {
-					s << format(translate("marker {}"), number) << " ";
+					s << format(translate("marker {}"), markerEntry->number) << " ";
 				}
 			}
 		}
 		this->lastMarker = marker;
 		if (region >= 0 && region != this->lastRegion) {
-			EnumProjectMarkers(region, nullptr, nullptr, nullptr, &name, &number);
-			if (name[0]) {
+			if (!regionEntry->name.empty()) {
 				// Translators: Reported when playback reaches a named region. {} will
 				// be replaced with the region's name; e.g. "intro region".
-				s << format(translate("{} region"), name) << " ";
+				s << format(translate("{} region"), regionEntry->name) << " ";
 			} else {
 				// Translators: Reported when playback reaches an unnamed region. {}
 				// will be replaced with the region's number; e.g. "region 2".
-				s << format(translate("region {}"), number) << " ";
+				s << format(translate("region {}"), regionEntry->number) << " ";
 			}
 		}
 		this->lastRegion = region;
@@ -360,6 +687,8 @@ class Surface: public IReaperControlSurface {
 	}
 
 	void reportTimeSelectionWhilePlaying(double playPos) {
+		// The time selection can change during playback without changing the
+		// project state change count, so don't cache it. This is cheap anyway.
 		double start, end;
 		GetSet_LoopTimeRange(false, false, &start, &end, false);
 		if (start == end) {
@@ -384,35 +713,51 @@ class Surface: public IReaperControlSurface {
 
 	void reportInputMidiNote() {
 		if (!isShortcutHelpEnabled) {
+			this->midiInput.reset();
 			return;
 		}
 		constexpr unsigned char MIDI_NOTE_ON_C0 = 0x90;
 		constexpr unsigned char MIDI_NOTE_ON_C15 = MIDI_NOTE_ON_C0 + 15;
-		static int lastIndex = 0;
-		unsigned char event[3];
-		int eventSize = sizeof(event);
-		int device;
-		int index = MIDI_GetRecentInputEvent(0, (char*)event, &eventSize, nullptr,
-			&device, nullptr, nullptr);
-		unsigned char status = event[0];
-		if (index == lastIndex || status < MIDI_NOTE_ON_C0 ||
-				status > MIDI_NOTE_ON_C15 || event[2] == 0) {
-			// Already reported this note, not a MIDI note on or MIDI note on with
-			// 0 velocity (which is equivalent to note off).
-			return;
-		}
-		lastIndex = index;
+		this->midiInput.drain();
 		MediaTrack* track = GetLastTouchedTrack();
 		if (!track || !isTrackArmed(track)) {
+			this->midiInput.clear();
 			return;
 		}
-		int channel = status - MIDI_NOTE_ON_C0;
-		const string noteName = getMidiNoteName(track, event[1], channel);
-		if (!noteName.empty()) {
-			outputMessage(noteName);
+		// All notes played since the last poll are reported in a single message,
+		// so a chord is reported as one utterance.
+		ostringstream s;
+		MidiInputReader::Event event;
+		int lastChannel = -1;
+		while (this->midiInput.pop(event)) {
+			if (event.status < MIDI_NOTE_ON_C0 || event.status > MIDI_NOTE_ON_C15 ||
+					event.data2 == 0) {
+				// Not a MIDI note on or MIDI note on with 0 velocity (which is
+				// equivalent to note off).
+				continue;
+			}
+			int channel = event.status - MIDI_NOTE_ON_C0;
+			if (channel != lastChannel) {
+				this->midiNoteNames.select(track, channel);
+				lastChannel = channel;
+			}
+			const string& noteName = this->midiNoteNames.get(event.data1);
+			if (noteName.empty()) {
+				continue;
+			}
+			if (s.tellp() > 0) {
+				s << ", ";
+			}
+			s << noteName;
+		}
+		if (s.tellp() > 0) {
+			outputMessage(s);
 		}
 	}
 
+	MidiInputReader midiInput;
+	MidiNoteNameTable midiNoteNames;
+
 	MediaTrack* lastSelectedTrack = nullptr;
 	MediaTrack* lastChangedTrack = nullptr;
 	int lastFx = 0;
@@ -420,8 +765,11 @@ class Surface: public IReaperControlSurface {
 	const int PARAM_VOLUME = -2;
 	const int PARAM_PAN = -3;
 	int lastParam = PARAM_NONE;
-	map<MediaTrack*, uint8_t> trackCache;
+	TrackCacheTable trackCache;
+	ReaProject* trackCacheProject = nullptr;
+	vector<PendingStateChange> pendingStateChanges;
 	double lastPlayPos = 0;
+	MarkerTimeline timeline;
 	int lastMarker = -1;
 	int lastRegion = -1;
 	bool hasReportedTimeSelection = false;
@@ -8,13 +8,14 @@
 #include <string>
 #include <sstream>
 #include <tuple>
-#include <regex>
 #include <functional>
-#include <set>
+#include <map>
+#include <vector>
 #include <algorithm>
 #include <optional>
 #include "osara.h"
 #include "translation.h"
+#include "stateChunk.h"
 
 using namespace std;
 using namespace fmt::literals;
@@ -334,11 +335,110 @@ void cmdInsertEnvelopePoint(Command* command) {
 	moveToEnvelopePoint(0); // Select and report inserted point.
 }
 
-const regex RE_ENVELOPE_STATE("<(AUX|HW)?(\\S+)[^]*?\\sACT (0|1)[^]*?\\sVIS (0|1)[^]*?\\sARM (0|1)");
+struct EnvelopeState {
+	// False if the chunk couldn't be parsed, in which case the other members
+	// shouldn't be used.
+	bool isValid = false;
+	// "AUX" for send envelopes, "HW" for hardware output envelopes, otherwise
+	// empty.
+	string prefix;
+	// e.g. "VOLENV"
+	string type;
+	bool active = false;
+	bool visible = false;
+	bool armed = false;
+};
+
+EnvelopeState getEnvelopeState(TrackEnvelope* envelope) {
+	EnvelopeState envState;
+	// We only need the first few lines, so don't retrieve the points. The
+	// buffer is deliberately too small for the whole chunk, so ignore the return
+	// value and parse the truncated header. The buffer is initialised so that
+	// it is empty if nothing is written at all.
+	char state[200] = "";
+	GetEnvelopeStateChunk(envelope, state, sizeof(state), false);
+	ChunkScanner scanner(state);
+	if (!scanner.next() || scanner.tag().size() < 2 || scanner.tag()[0] != '<') {
+		return envState;
+	}
+	string_view type = scanner.tag().substr(1);
+	for (string_view prefix : {"AUX", "HW"}) {
+		if (type.size() > prefix.size() && type.substr(0, prefix.size()) == prefix) {
+			envState.prefix = prefix;
+			type.remove_prefix(prefix.size());
+			break;
+		}
+	}
+	envState.type = type;
+	bool foundActive = false, foundVisible = false, foundArmed = false;
+	while (!(foundActive && foundVisible && foundArmed) && scanner.next()) {
+		if (scanner.depth() != 1) {
+			continue;
+		}
+		string_view tag = scanner.tag();
+		if (tag == "ACT") {
+			envState.active = scanner.word(1) == "1";
+			foundActive = true;
+		} else if (tag == "VIS") {
+			envState.visible = scanner.word(1) == "1";
+			foundVisible = true;
+		} else if (tag == "ARM") {
+			envState.armed = scanner.word(1) == "1";
+			foundArmed = true;
+		}
+	}
+	envState.isValid = foundActive && foundVisible && foundArmed;
+	return envState;
+}
+
+// Parsing envelope state means serialising the envelope's chunk, which is
+// slow for tracks with many envelopes. We therefore cache the state for each
+// envelope of a track or take in envelope order. The cache is discarded when
+// the project state change count changes or the project is switched.
+struct CachedEnvelopeState {
+	TrackEnvelope* envelope = nullptr;
+	EnvelopeState state;
+};
+ReaProject* envelopeCacheProject = nullptr;
+int envelopeCacheStateCount = 0;
+// Keyed by the MediaTrack* or MediaItem_Take* which owns the envelopes.
+map<void*, vector<CachedEnvelopeState>> envelopeStateCache;
+
+void invalidateEnvelopeStateCache() {
+	envelopeStateCache.clear();
+	envelopeCacheProject = nullptr;
+}
+
+// Get the state of the envelope at index for owner (a track or take), using the
+// cache if possible.
+const EnvelopeState& getCachedEnvelopeState(void* owner, int index,
+	TrackEnvelope* envelope
+) {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	int stateCount = GetProjectStateChangeCount(project);
+	if (project != envelopeCacheProject ||
+			stateCount != envelopeCacheStateCount) {
+		envelopeStateCache.clear();
+		envelopeCacheProject = project;
+		envelopeCacheStateCount = stateCount;
+	}
+	auto& states = envelopeStateCache[owner];
+	if (index >= (int)states.size()) {
+		states.resize(index + 1);
+	}
+	CachedEnvelopeState& cached = states[index];
+	if (cached.envelope != envelope) {
+		cached.state = getEnvelopeState(envelope);
+		cached.envelope = envelope;
+	}
+	return cached.state;
+}
+
 void cmdhSelectEnvelope(int direction) {
 	MediaTrack* track = nullptr;
 	int count;
 	function<TrackEnvelope*(int)> getEnvelope;
+	void* owner;
 	// selectedEnvelopeIsTake is set when focus changes to track or item.
 	if (selectedEnvelopeIsTake) {
 		MediaItem* item = GetSelectedMediaItem(0, 0);
@@ -349,12 +449,14 @@ void cmdhSelectEnvelope(int direction) {
 			return;
 		count = CountTakeEnvelopes(take);
 		getEnvelope = [take] (int index) { return GetTakeEnvelope(take, index); };
+		owner = take;
 	} else {
 		track = GetLastTouchedTrack();
 		if (!track)
 			return;
 		count = CountTrackEnvelopes(track);
 		getEnvelope = [track] (int index) { return GetTrackEnvelope(track, index); };
+		owner = track;
 	}
 	if (count == 0) {
 		outputMessage(selectedEnvelopeIsTake ?
@@ -383,7 +485,7 @@ void cmdhSelectEnvelope(int direction) {
 	}
 
 	// Get the next envelope in the requested direction.
-	cmatch m;
+	EnvelopeState envState;
 	index = origIndex;
 	for (; ;) {
 		index += direction;
@@ -398,10 +500,8 @@ void cmdhSelectEnvelope(int direction) {
 			}
 		}
 		env = getEnvelope(index);
-		char state[200];
-		GetEnvelopeStateChunk(env, state, sizeof(state), false);
-		regex_search(state, m, RE_ENVELOPE_STATE);
-		bool invisible = !m.empty() && m.str(4)[0] == '0';
+		envState = getCachedEnvelopeState(owner, index, env);
+		bool invisible = envState.isValid && !envState.visible;
 		if (env == origEnv) {
 			// We're back where we started. Don't try to go any further.
 			if (invisible) {
@@ -425,9 +525,9 @@ void cmdhSelectEnvelope(int direction) {
 	fakeFocus = FOCUS_ENVELOPE;
 	shouldMoveToAutoItem = true;
 	ostringstream s;
-	if (!m.empty() && m.str(1).compare("AUX") == 0) {
+	if (envState.isValid && envState.prefix == "AUX") {
 		// Send envelope. Get the name of the send.
-		string envType = '<' + m.str(2); // e.g. <VOLENV
+		string envType = '<' + envState.type; // e.g. <VOLENV
 		int sendCount = GetTrackNumSends(track, 0);
 		for (int i = 0; i < sendCount; ++i) {
 			TrackEnvelope* sendEnv = (TrackEnvelope*)GetSetTrackSendInfo(track, 0, i, "P_ENV", (void*)envType.c_str());
@@ -445,11 +545,11 @@ void cmdhSelectEnvelope(int direction) {
 	// Translators: Reported when selecting an envelope. {} will be replaced
 	// with the name of the envelope; e.g. "volume envelope".
 	s << format(translate("{} envelope"), name);
-	if (!m.empty()) {
-		if (m.str(3)[0] == '0') {
+	if (envState.isValid) {
+		if (!envState.active) {
 			s << " " << translate("bypassed");
 		}
-		if (m.str(5)[0] == '1') {
+		if (envState.armed) {
 			s << " " << translate("armed");
 		}
 	}
@@ -625,25 +725,22 @@ void reportCopiedEnvelopePointsOrAutoItems() {
 	}
 }
 
-bool isEnvelopeVisible(TrackEnvelope* envelope) {
-	char state[200];
-	GetEnvelopeStateChunk(envelope, state, sizeof(state), false);
-	cmatch m;
-	regex_search(state, m, RE_ENVELOPE_STATE);
-	return !m.empty() && m.str(4)[0] == '1';
-}
-
-set<TrackEnvelope*> getVisibleEnvelopes(auto obj,
+// Returns the visible envelopes sorted by pointer so that they can be
+// compared with set algorithms.
+vector<TrackEnvelope*> getVisibleEnvelopes(auto obj,
 	auto countFunc, auto getFunc
 ) {
-	set<TrackEnvelope*> envelopes;
+	vector<TrackEnvelope*> envelopes;
 	int count = countFunc(obj);
+	envelopes.reserve(count);
 	for (int i = 0; i < count; ++i) {
 		TrackEnvelope* env = getFunc(obj, i);
-		if (isEnvelopeVisible(env)) {
-			envelopes.emplace(env);
+		const EnvelopeState& envState = getCachedEnvelopeState(obj, i, env);
+		if (envState.isValid && envState.visible) {
+			envelopes.push_back(env);
 		}
 	}
+	sort(envelopes.begin(), envelopes.end());
 	return envelopes;
 }
 
@@ -651,16 +748,20 @@ void cmdhToggleEnvelope(int command, auto obj,
 	auto countFunc, auto getFunc,
 	const char* showedMsg, const char* hidMsg
 ) {
-	set<TrackEnvelope*> before = getVisibleEnvelopes(obj, countFunc, getFunc);
+	// Visibility can change without changing the project state change count, so
+	// neither the state before nor after the command can come from the cache.
+	invalidateEnvelopeStateCache();
+	vector<TrackEnvelope*> before = getVisibleEnvelopes(obj, countFunc, getFunc);
 	Main_OnCommand(command, 0);
-	set<TrackEnvelope*> after = getVisibleEnvelopes(obj, countFunc, getFunc);
+	invalidateEnvelopeStateCache();
+	vector<TrackEnvelope*> after = getVisibleEnvelopes(obj, countFunc, getFunc);
 	if (after.size() == before.size()) {
 		outputMessage(translate("no envelopes toggled"));
 		return;
 	}
-	set<TrackEnvelope*> difference;
+	vector<TrackEnvelope*> difference;
 	set_symmetric_difference(before.begin(), before.end(),
-		after.begin(), after.end(), inserter(difference, difference.end()));
+		after.begin(), after.end(), back_inserter(difference));
 	TrackEnvelope* envelope = *difference.begin();
 	char name[50];
 	GetEnvelopeName(envelope, name, sizeof(name));
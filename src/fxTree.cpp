@@ -0,0 +1,108 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Flattened FX tree code
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <cstdlib>
+#include <map>
+#include <type_traits>
+#include "fxTree.h"
+
+using namespace std;
+
+ReaProject* fxTreesProject = nullptr;
+int fxTreesStateCount = 0;
+map<void*, FxTree> fxTrees;
+
+void invalidateFxTrees() {
+	fxTrees.clear();
+}
+
+template<typename ReaperObj>
+const FxTree& FxTree::getCached(ReaperObj* obj) {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	int stateCount = GetProjectStateChangeCount(project);
+	if (project != fxTreesProject || stateCount != fxTreesStateCount) {
+		fxTrees.clear();
+		fxTreesProject = project;
+		fxTreesStateCount = stateCount;
+	}
+	auto [it, inserted] = fxTrees.try_emplace(obj);
+	if (inserted) {
+		it->second.build(obj);
+	}
+	return it->second;
+}
+
+const FxTree& FxTree::get(MediaTrack* track) {
+	return getCached(track);
+}
+
+const FxTree& FxTree::get(MediaItem_Take* take) {
+	return getCached(take);
+}
+
+template<typename ReaperObj>
+void FxTree::build(ReaperObj* obj) {
+	this->entries.clear();
+	if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+		this->addChain(obj, TrackFX_GetCount(obj), false, 1, 0, 1);
+		// There might be input or monitoring effects.
+		this->addChain(obj, TrackFX_GetRecCount(obj), true, 1, 0, 1);
+	} else {
+		this->addChain(obj, TakeFX_GetCount(obj), false, 1, 0, 1);
+	}
+}
+
+template<typename ReaperObj>
+void FxTree::addChain(ReaperObj* obj, int count, bool isRec, int level,
+	int containerFxIndex, int multiplier
+) {
+	for (int i = 0; i < count; ++i) {
+		Entry entry;
+		entry.fxIndex = isRec ? 0x1000000 : 0;
+		if (level == 1) {
+			// We're not in a container.
+			entry.fxIndex += i;
+		} else {
+			entry.fxIndex += (i + 1) * multiplier + containerFxIndex;
+		}
+		entry.level = level;
+		entry.indexInContainer = i;
+		entry.isRec = isRec;
+		char res[256] = "0";
+		// If this is a container, find out how many effects it contains.
+		if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+			TrackFX_GetNamedConfigParm(obj, entry.fxIndex, "container_count", res,
+				sizeof(res));
+		} else {
+			TakeFX_GetNamedConfigParm(obj, entry.fxIndex, "container_count", res,
+				sizeof(res));
+		}
+		const int containedCount = atoi(res);
+		entry.isContainer = containedCount > 0;
+		if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+			TrackFX_GetFXName(obj, entry.fxIndex, res, sizeof(res));
+			entry.enabled = TrackFX_GetEnabled(obj, entry.fxIndex);
+			entry.deltaParam = TrackFX_GetParamFromIdent(obj, entry.fxIndex,
+				":delta");
+		} else {
+			TakeFX_GetFXName(obj, entry.fxIndex, res, sizeof(res));
+			entry.enabled = TakeFX_GetEnabled(obj, entry.fxIndex);
+			entry.deltaParam = -1;
+		}
+		entry.name = res;
+		const int fxIndex = entry.fxIndex;
+		this->entries.push_back(std::move(entry));
+		if (containedCount > 0) {
+			// Effects in a top level container are addressed relative to
+			// 0x2000000 + the container's 1 based index. Deeper containers are
+			// addressed relative to the container's own encoded index.
+			int subContainerFxIndex = level == 1 ? 0x2000000 + i + 1 : fxIndex;
+			this->addChain(obj, containedCount, isRec, level + 1,
+				subContainerFxIndex, multiplier * (count + 1));
+		}
+	}
+}
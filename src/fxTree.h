@@ -0,0 +1,66 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Flattened FX tree header
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "osara.h"
+
+// A flattened list of all the effects on a track or take, including effects
+// nested in containers and input/monitoring effects. Walking containers means
+// several API calls per effect, which adds up for deeply nested chains, so
+// trees are built lazily and are all discarded when the project state change
+// count changes, the project is switched or invalidateFxTrees() is called.
+class FxTree {
+	public:
+	struct Entry {
+		// The index to pass to the FX API functions. For effects in containers or
+		// input/monitoring effects, this is the encoded index.
+		int fxIndex;
+		// 1 for effects which aren't in a container, 2 for effects in a top level
+		// container, etc.
+		int level;
+		// The 0 based position of the effect within its container or chain.
+		int indexInContainer;
+		bool isContainer;
+		// Whether this is an input or monitoring effect.
+		bool isRec;
+		bool enabled;
+		// The index of the delta solo parameter, or -1 if there is none. This is
+		// only fetched for track effects.
+		int deltaParam;
+		// The name as returned by the API; i.e. not shortened.
+		std::string name;
+	};
+
+	// Get the tree for a track or take, building it if necessary. The returned
+	// reference is only valid until the trees are discarded.
+	static const FxTree& get(MediaTrack* track);
+	static const FxTree& get(MediaItem_Take* take);
+
+	// Entries are in depth first order; i.e. a container is followed by its
+	// contents.
+	const std::vector<Entry>& getEntries() const {
+		return this->entries;
+	}
+
+	private:
+	template<typename ReaperObj>
+	static const FxTree& getCached(ReaperObj* obj);
+	template<typename ReaperObj>
+	void build(ReaperObj* obj);
+	template<typename ReaperObj>
+	void addChain(ReaperObj* obj, int count, bool isRec, int level,
+		int containerFxIndex, int multiplier);
+
+	std::vector<Entry> entries;
+};
+
+// Discard all cached FX trees. This should be called when effects are added,
+// removed, reordered or enabled/bypassed.
+void invalidateFxTrees();
@@ -0,0 +1,107 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Track item position index code
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <map>
+#include "itemIndex.h"
+
+using namespace std;
+
+ReaProject* indexedProject = nullptr;
+int indexedStateCount = 0;
+map<MediaTrack*, TrackItemIndex> trackItemIndexes;
+
+const TrackItemIndex& TrackItemIndex::get(MediaTrack* track) {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	int stateCount = GetProjectStateChangeCount(project);
+	if (project != indexedProject || stateCount != indexedStateCount) {
+		trackItemIndexes.clear();
+		indexedProject = project;
+		indexedStateCount = stateCount;
+	}
+	auto [it, inserted] = trackItemIndexes.try_emplace(track);
+	if (inserted) {
+		it->second.build(track);
+	}
+	return it->second;
+}
+
+void TrackItemIndex::keepAfterSelectionChange() {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	if (project == indexedProject) {
+		indexedStateCount = GetProjectStateChangeCount(project);
+	}
+}
+
+void TrackItemIndex::build(MediaTrack* track) {
+	int count = CountTrackMediaItems(track);
+	this->entries.resize(count);
+	this->isSorted = true;
+	vector<IntervalIndex<int>::Interval> intervals;
+	intervals.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		MediaItem* item = GetTrackMediaItem(track, i);
+		double start = *(double*)GetSetMediaItemInfo(item, "D_POSITION", nullptr);
+		double end = start +
+			*(double*)GetSetMediaItemInfo(item, "D_LENGTH", nullptr);
+		this->entries[i] = {start, end, item};
+		if (i > 0 && start < this->entries[i - 1].start) {
+			this->isSorted = false;
+		}
+		intervals.push_back({start, end, i});
+	}
+	this->intervals.build(move(intervals));
+}
+
+int TrackItemIndex::findFirstStartingAtOrAfter(double pos) const {
+	if (!this->isSorted) {
+		for (int i = 0; i < this->count(); ++i) {
+			if (this->entries[i].start >= pos) {
+				return i;
+			}
+		}
+		return this->count();
+	}
+	auto it = lower_bound(this->entries.begin(), this->entries.end(), pos,
+		[](const Entry& entry, double pos) { return entry.start < pos; });
+	return (int)(it - this->entries.begin());
+}
+
+int TrackItemIndex::findLastStartingAtOrBefore(double pos) const {
+	if (!this->isSorted) {
+		for (int i = this->count() - 1; i >= 0; --i) {
+			if (this->entries[i].start <= pos) {
+				return i;
+			}
+		}
+		return -1;
+	}
+	auto it = upper_bound(this->entries.begin(), this->entries.end(), pos,
+		[](double pos, const Entry& entry) { return pos < entry.start; });
+	return (int)(it - this->entries.begin()) - 1;
+}
+
+int TrackItemIndex::indexOf(MediaItem* item) const {
+	if (!this->isSorted) {
+		for (int i = 0; i < this->count(); ++i) {
+			if (this->entries[i].item == item) {
+				return i;
+			}
+		}
+		return -1;
+	}
+	// Several items might start at the same position, so jump to the first of
+	// them and scan from there.
+	double start = *(double*)GetSetMediaItemInfo(item, "D_POSITION", nullptr);
+	for (int i = this->findFirstStartingAtOrAfter(start);
+			i < this->count() && this->entries[i].start == start; ++i) {
+		if (this->entries[i].item == item) {
+			return i;
+		}
+	}
+	return -1;
+}
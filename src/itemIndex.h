@@ -0,0 +1,72 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Track item position index header
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <vector>
+#include "osara.h"
+#include "timeline.h"
+
+// A cached array of the items on a track along with their start and end
+// positions. Finding the item before or after a position by asking REAPER for
+// the position of every item is slow for tracks with thousands of items, so
+// this allows a binary search instead. Indexes are built lazily and are all
+// discarded when the project state change count changes (except for changes
+// OSARA knows can't affect them) or the project is switched.
+class TrackItemIndex {
+	public:
+	struct Entry {
+		double start;
+		double end;
+		MediaItem* item;
+	};
+
+	// Get the index for a track, building it if necessary. The returned reference
+	// is only valid until the project changes.
+	static const TrackItemIndex& get(MediaTrack* track);
+	// Keep the existing indexes even though the project state change count has
+	// changed since they were validated. This should be called after a change
+	// which can't affect items' positions or the item list; e.g. selecting
+	// items. Otherwise, navigating items would rebuild the index on every move,
+	// since moving changes the selection.
+	static void keepAfterSelectionChange();
+
+	int count() const {
+		return (int)this->entries.size();
+	}
+	// Entries are in track order; i.e. the same order as GetTrackMediaItem.
+	const Entry& operator[](int index) const {
+		return this->entries[index];
+	}
+
+	// The index of the first item which starts at or after pos, or count() if
+	// there is none.
+	int findFirstStartingAtOrAfter(double pos) const;
+	// The index of the last item which starts at or before pos, or -1 if there
+	// is none.
+	int findLastStartingAtOrBefore(double pos) const;
+	// The index of item, or -1 if it isn't on this track.
+	int indexOf(MediaItem* item) const;
+	// Call func(index, entry) for each item which contains pos, in order of
+	// start (which is track order unless REAPER hasn't sorted the items).
+	void forEachItemAt(double pos, auto func) const {
+		this->intervals.forEachContaining(pos, /* includeEnd */ true,
+			[this, &func](const auto& interval) {
+				func(interval.value, this->entries[interval.value]);
+			});
+	}
+
+	private:
+	void build(MediaTrack* track);
+
+	std::vector<Entry> entries;
+	// Maps to indexes in entries.
+	IntervalIndex<int> intervals;
+	// REAPER keeps items in position order, but if that ever isn't the case, we
+	// fall back to linear searches.
+	bool isSorted = true;
+};
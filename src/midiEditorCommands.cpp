@@ -9,17 +9,20 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <map>
 #include <cassert>
 #include <functional>
 #include <float.h>
 #include <compare>
-#include<regex>
 #include<string_view>
 #include "midiEditorCommands.h"
 #include "osara.h"
 #include "config.h"
 #include "translation.h"
+#include "itemIndex.h"
+#include "stateChunk.h"
 #ifdef _WIN32
 #include <Commctrl.h>
 #endif
@@ -27,38 +30,64 @@
 using namespace std;
 using namespace fmt::literals;
 
-// returns the pulses per quarter note of the first midi source in the item.
-int getItemPPQ(MediaItem* item) {
-	const int defaultPPQ = 960;
-	static MediaItem* cachedItem;
-	static int cachedPPQ;
-	if(item == cachedItem) {
-		return cachedPPQ;
+struct FreeReaperPtr {
+	void operator()(void* p) {
+		FreeHeapPtr(p);
 	}
-	char buff[4096] = "";
-	if(!GetItemStateChunk(item, buff, sizeof(buff), false)) {
+};
+
+// Fetching the PPQ means copying the item's state chunk, which can be large
+// for MIDI items. The PPQ only changes when the take's source is replaced, so
+// each cached value is kept as long as the take has the same source.
+struct CachedTakePPQ {
+	PCM_source* source;
+	int ppq;
+};
+ReaProject* ppqCacheProject = nullptr;
+map<MediaItem_Take*, CachedTakePPQ> ppqCache;
+
+// returns the pulses per quarter note of the take's midi source.
+int getTakePPQ(MediaItem_Take* take) {
+	const int defaultPPQ = 960;
+	if (!take) {
 		return defaultPPQ;
 	}
-	static const regex re("^\\s*HASDATA [0-9]+ ([0-9]+) ");
-	cmatch match;
-	if(!regex_search(buff, match, re)) {
-		return defaultPPQ;
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	if (project != ppqCacheProject) {
+		ppqCache.clear();
+		ppqCacheProject = project;
+	}
+	PCM_source* source = GetMediaItemTake_Source(take);
+	auto it = ppqCache.find(take);
+	if (it != ppqCache.end() && it->second.source == source) {
+		return it->second.ppq;
 	}
-	int ppq = stoi(match.str(1));
-	cachedPPQ = ppq;
-	cachedItem = item;
+	int ppq = 0;
+	MediaItem* item = GetMediaItemTake_Item(take);
+	// GetSetObjectState returns the whole chunk without a size limit, so we can
+	// scan it in place.
+	unique_ptr<char, FreeReaperPtr> state(GetSetObjectState(item, ""));
+	if (state) {
+		// Look for the HASDATA line in this take's source. If we can't find the
+		// take, fall back to the first source in the item.
+		char guid[40] = "";
+		GetSetMediaItemTakeInfo_String(take, "GUID", guid, false);
+		ChunkScanner scanner(state.get());
+		if (scanner.findTake(guid) && scanner.findTagInTake("HASDATA")) {
+			ppq = (int)scanner.number(2);
+		} else if (ChunkScanner first(state.get()); first.findTag("HASDATA")) {
+			ppq = (int)first.number(2);
+		}
+	}
+	if (!ppq) {
+		ppq = defaultPPQ;
+	}
+	ppqCache[take] = {source, ppq};
 	return ppq;
 }
 
-struct FreeReaperPtr {
-	void operator()(void* p) {
-		FreeHeapPtr(p);
-	}
-};
-
 // return the midi editor zoom ratio of the take
 double getMidiZoomRatio(MediaItem_Take* take) {
-	static const regex re("CFGEDITVIEW -?[0-9.]+ ([0-9.]+) ");
 	char guid[40]; 
 	GetSetMediaItemTakeInfo_String(take, "GUID", guid, false);
 	MediaItem* item = GetMediaItemTake_Item(take);
@@ -66,18 +95,206 @@ double getMidiZoomRatio(MediaItem_Take* take) {
 	if(!state) {
 		return -1;
 	}
-	auto stateSV = string_view(state.get());
-	size_t takePos = stateSV.find(guid);
-	if (takePos == string::npos) {
+	// The line looks like "CFGEDITVIEW <position> <zoom> ...".
+	ChunkScanner scanner(state.get());
+	if (!scanner.findTake(guid) || !scanner.findTagInTake("CFGEDITVIEW")) {
 		return -1;
 	}
-	match_results<string_view::const_iterator> match;
-	if (!regex_search(stateSV.cbegin() + takePos, stateSV.cend(), match, re)) {
-		return -1;
+	return scanner.number(2);
+}
+
+// Reading MIDI events one at a time with MIDI_GetNote/MIDI_GetCC is slow for
+// large takes, since searches such as equal_range read many events. These
+// snapshots read all notes or CCs in a take once into a buffer per field. The
+// most recent snapshot is reused until the take's MIDI hash changes. Snapshots
+// are shared so that an iterator can keep using its snapshot even if a newer
+// one is taken.
+// Positions are stored in PPQ and only converted to project time when read,
+// so moving the item or changing the tempo doesn't make a snapshot stale.
+// Selection isn't stored either, since OSARA changes it when navigating. See
+// MidiSelectionChange.
+string getMidiHash(MediaItem_Take* take, bool notesOnly) {
+	char hash[64];
+	if (!MIDI_GetHash(take, notesOnly, hash, sizeof(hash))) {
+		return "";
 	}
-	return stod(match.str(1));
+	return hash;
 }
 
+struct MidiNoteSnapshot {
+	MediaItem_Take* take = nullptr;
+	vector<double> start;
+	vector<double> end;
+	vector<int> channel;
+	vector<int> pitch;
+	vector<int> velocity;
+	vector<char> muted;
+
+	int count() const {
+		return (int)this->start.size();
+	}
+
+	double toTime(double ppq) const {
+		return MIDI_GetProjTimeFromPPQPos(this->take, ppq);
+	}
+
+	static shared_ptr<const MidiNoteSnapshot> get(MediaItem_Take* take) {
+		string hash = getMidiHash(take, /* notesOnly */ true);
+		if (isCurrent(take, hash)) {
+			return cached;
+		}
+		auto snapshot = make_shared<MidiNoteSnapshot>();
+		snapshot->take = take;
+		int count = 0;
+		MIDI_CountEvts(take, &count, nullptr, nullptr);
+		snapshot->start.reserve(count);
+		snapshot->end.reserve(count);
+		snapshot->channel.reserve(count);
+		snapshot->pitch.reserve(count);
+		snapshot->velocity.reserve(count);
+		snapshot->muted.reserve(count);
+		bool muted;
+		double start, end;
+		int channel, pitch, velocity;
+		for (int i = 0; MIDI_GetNote(take, i, nullptr, &muted, &start, &end,
+				&channel, &pitch, &velocity); ++i) {
+			snapshot->start.push_back(start);
+			snapshot->end.push_back(end);
+			snapshot->channel.push_back(channel);
+			snapshot->pitch.push_back(pitch);
+			snapshot->velocity.push_back(velocity);
+			snapshot->muted.push_back(muted);
+		}
+		cached = snapshot;
+		cachedHash = hash;
+		return snapshot;
+	}
+
+	static bool isCurrent(MediaItem_Take* take, const string& hash) {
+		return cached && cached->take == take && !hash.empty() &&
+			hash == cachedHash;
+	}
+
+	static bool isCurrent(MediaItem_Take* take) {
+		return isCurrent(take, getMidiHash(take, /* notesOnly */ true));
+	}
+
+	// Accept the take's current hash for the cached snapshot. This must only be
+	// called if the snapshot was current before a change which can't affect it.
+	static void updateHash(MediaItem_Take* take) {
+		cachedHash = getMidiHash(take, /* notesOnly */ true);
+	}
+
+	private:
+	static inline shared_ptr<const MidiNoteSnapshot> cached;
+	static inline string cachedHash;
+};
+
+struct MidiControlChangeSnapshot {
+	MediaItem_Take* take = nullptr;
+	vector<double> position;
+	vector<int> message1;
+	vector<int> channel;
+	vector<int> message2;
+	vector<int> message3;
+	vector<char> muted;
+
+	int count() const {
+		return (int)this->position.size();
+	}
+
+	double toTime(double ppq) const {
+		return MIDI_GetProjTimeFromPPQPos(this->take, ppq);
+	}
+
+	// The index of the first CC whose position is at or after pos (in project
+	// time). Comparisons are done in project time so that they exactly match
+	// positions reported to the user and the cursor set from them.
+	int findFirstAtOrAfter(double pos) const {
+		return (int)(lower_bound(this->position.begin(), this->position.end(), pos,
+			[this](double ppq, double pos) {
+				return this->toTime(ppq) < pos;
+			}) - this->position.begin());
+	}
+
+	static shared_ptr<const MidiControlChangeSnapshot> get(MediaItem_Take* take) {
+		string hash = getMidiHash(take, /* notesOnly */ false);
+		if (isCurrent(take, hash)) {
+			return cached;
+		}
+		auto snapshot = make_shared<MidiControlChangeSnapshot>();
+		snapshot->take = take;
+		int count = 0;
+		MIDI_CountEvts(take, nullptr, &count, nullptr);
+		snapshot->position.reserve(count);
+		snapshot->message1.reserve(count);
+		snapshot->channel.reserve(count);
+		snapshot->message2.reserve(count);
+		snapshot->message3.reserve(count);
+		snapshot->muted.reserve(count);
+		bool muted;
+		double position;
+		int message1, channel, message2, message3;
+		for (int i = 0; MIDI_GetCC(take, i, nullptr, &muted, &position,
+				&message1, &channel, &message2, &message3); ++i) {
+			snapshot->position.push_back(position);
+			snapshot->message1.push_back(message1);
+			snapshot->channel.push_back(channel);
+			snapshot->message2.push_back(message2);
+			snapshot->message3.push_back(message3);
+			snapshot->muted.push_back(muted);
+		}
+		cached = snapshot;
+		cachedHash = hash;
+		return snapshot;
+	}
+
+	static bool isCurrent(MediaItem_Take* take, const string& hash) {
+		return cached && cached->take == take && !hash.empty() &&
+			hash == cachedHash;
+	}
+
+	static bool isCurrent(MediaItem_Take* take) {
+		return isCurrent(take, getMidiHash(take, /* notesOnly */ false));
+	}
+
+	// Accept the take's current hash for the cached snapshot. This must only be
+	// called if the snapshot was current before a change which can't affect it.
+	static void updateHash(MediaItem_Take* take) {
+		cachedHash = getMidiHash(take, /* notesOnly */ false);
+	}
+
+	private:
+	static inline shared_ptr<const MidiControlChangeSnapshot> cached;
+	static inline string cachedHash;
+};
+
+// The MIDI hash includes selection, so changing the selection would otherwise
+// discard the snapshots and navigating would rebuild them on every key press.
+// Construct one of these before OSARA changes the selection of notes or CCs.
+// When it is destroyed, any snapshot which was current before the change is
+// kept.
+class MidiSelectionChange {
+	public:
+	MidiSelectionChange(MediaItem_Take* take): take(take),
+		notesCurrent(MidiNoteSnapshot::isCurrent(take)),
+		ccsCurrent(MidiControlChangeSnapshot::isCurrent(take)) {}
+
+	~MidiSelectionChange() {
+		if (this->notesCurrent) {
+			MidiNoteSnapshot::updateHash(this->take);
+		}
+		if (this->ccsCurrent) {
+			MidiControlChangeSnapshot::updateHash(this->take);
+		}
+	}
+
+	private:
+	MediaItem_Take* take;
+	bool notesCurrent;
+	bool ccsCurrent;
+};
+
 // Note: while the below struct is called MidiControlChange in line with naming in Reaper,
 // It is also used for other MIDI messages.
 struct MidiControlChange {
@@ -162,6 +379,54 @@ struct MidiControlChange {
 		}
 		return count;
 	}
+
+	// Get a CC from a snapshot. The message fields and muted are always
+	// provided. The position and selection cost a call into REAPER each, so
+	// they're only provided if requested.
+	static const MidiControlChange get(const MidiControlChangeSnapshot& snapshot,
+		int index, bool position = true, bool selected = true
+	) {
+		MidiControlChange cc;
+		if (index < 0 || index >= snapshot.count()) {
+			cc.position = DBL_MAX;
+			return cc;
+		}
+		cc.channel = snapshot.channel[index];
+		cc.index = index;
+		cc.message1 = snapshot.message1[index];
+		cc.message2 = snapshot.message2[index];
+		cc.message3 = snapshot.message3[index];
+		if (position) {
+			cc.position = snapshot.toTime(snapshot.position[index]);
+		}
+		if (selected) {
+			MIDI_GetCC(snapshot.take, index, &cc.selected, nullptr, nullptr, nullptr,
+				nullptr, nullptr, nullptr);
+		}
+		cc.muted = snapshot.muted[index];
+		return cc;
+	}
+
+	// Get only the fields needed to compare or classify a CC; i.e. without
+	// calls into REAPER.
+	static const MidiControlChange getMessage(
+		const MidiControlChangeSnapshot& snapshot, int index
+	) {
+		return get(snapshot, index, /* position */ false, /* selected */ false);
+	}
+
+	static const MidiControlChange get(
+		const shared_ptr<const MidiControlChangeSnapshot>& snapshot, int index,
+		ReqParams params
+	) {
+		return get(*snapshot, index, params.position, params.selected);
+	}
+
+	static const int getCount(
+		const shared_ptr<const MidiControlChangeSnapshot>& snapshot
+	) {
+		return snapshot->count();
+	}
 } ;
 
 const UINT DEFAULT_PREVIEW_LENGTH = 300; // ms
@@ -235,6 +500,37 @@ struct MidiNote {
 		}
 		return count;
 	}
+
+	// Get a note from a snapshot. The start is always provided, since it is
+	// needed for searching. Fields which cost a call into REAPER are only
+	// provided if requested. Other fields are always provided.
+	static const MidiNote get(const shared_ptr<const MidiNoteSnapshot>& snapshot,
+		int index, ReqParams params
+	) {
+		MidiNote note;
+		if (index < 0 || index >= snapshot->count()) {
+			note.start = note.end = DBL_MAX;
+			return note;
+		}
+		note.channel = snapshot->channel[index];
+		note.pitch = snapshot->pitch[index];
+		note.velocity = snapshot->velocity[index];
+		note.index = index;
+		note.start = snapshot->toTime(snapshot->start[index]);
+		if (params.end) {
+			note.end = snapshot->toTime(snapshot->end[index]);
+		}
+		if (params.selected) {
+			MIDI_GetNote(snapshot->take, index, &note.selected, nullptr, nullptr,
+				nullptr, nullptr, nullptr, nullptr);
+		}
+		note.muted = snapshot->muted[index];
+		return note;
+	}
+
+	static const int getCount(const shared_ptr<const MidiNoteSnapshot>& snapshot) {
+		return snapshot->count();
+	}
 };
 
 struct MidiEventListData { 
@@ -260,8 +556,7 @@ struct MidiEventListData {
 		char eventData[255] = "\0";
 		if (MIDIEditor_GetSetting_str(editor, setting.c_str(), eventData, sizeof(eventData))) {
 			MediaItem_Take* take = MIDIEditor_GetTake (editor);
-			MediaItem* item = GetMediaItemTake_Item(take);
-			int ppq = getItemPPQ(item);
+			int ppq = getTakePPQ(take);
 			string key, val;
 			istringstream s(eventData);
 			double eventPosPpq = -1.0;
@@ -309,23 +604,57 @@ struct MidiEventListData {
 } ;
 
 vector<MidiNote> previewingNotes; // Notes currently being previewed.
-CallLater previewDoneLater;
 const int MIDI_NOTE_ON = 0x90;
 const int MIDI_NOTE_OFF = 0x80;
 
 // A minimal PCM_source to send MIDI events for preview.
+// Events are passed from the main thread to the audio thread through a
+// preallocated single producer, single consumer ring, so neither thread
+// allocates or takes a lock. Each event has a time relative to the start of its
+// batch, so note offs are sent by the audio thread at the right sample rather
+// than relying on a main thread timer.
 class PreviewSource : public PCM_source {
 	public:
-	
+
 	PreviewSource() {
 	}
 
 	virtual ~PreviewSource() {
 	}
 
-	// The events to send.
-	// These will be consumed (and the vector cleared) soon after PlayTrackPreview is called.
-	vector<MIDI_event_t> events;
+	// Queue an event for the next batch. Main thread only.
+	void queue(const unsigned char (&message)[3], double time) {
+		size_t head = this->head.load(memory_order_relaxed);
+		size_t next = (head + 1) % RING_SIZE;
+		if (next == this->tail.load(memory_order_acquire)) {
+			return; // Full. This should never happen in practice.
+		}
+		Event& event = this->ring[head];
+		event.batch = this->nextBatch;
+		event.time = time;
+		memcpy(event.message, message, sizeof(event.message));
+		this->head.store(next, memory_order_release);
+		this->length = max(this->length.load(memory_order_relaxed), time);
+	}
+
+	// Make the events queued since the last call available to the audio thread.
+	// Any events from previous batches which haven't been sent yet are dropped.
+	// Main thread only.
+	void publish() {
+		this->currentBatch.store(this->nextBatch, memory_order_release);
+		++this->nextBatch;
+	}
+
+	// Whether events from the last published batch haven't all been sent yet.
+	bool isPending() const {
+		return this->sentBatch.load(memory_order_acquire) !=
+			this->currentBatch.load(memory_order_acquire);
+	}
+
+	// Prepare for a new batch whose events will start at time 0.
+	void beginBatch() {
+		this->length = 0.0;
+	}
 
 	bool SetFileName(const char* fn) {
 		return false;
@@ -352,10 +681,9 @@ class PreviewSource : public PCM_source {
 	}
 
 	double GetLength() {
-		// This only needs to be long enough to send MIDI events immediately.
-		// Once we send note on events, the notes stay on, even though the preview stops.
-		// We then play another preview with more events to turn the notes off.
-		return 0.001;
+		// The preview must keep running until the last event in the batch (usually
+		// a note off) has been sent. Add a little so it isn't cut off at the end.
+		return this->length.load(memory_order_relaxed) + 0.05;
 	}
 
 	int PropertiesWindow(HWND parent) {
@@ -364,10 +692,43 @@ class PreviewSource : public PCM_source {
 
 	void GetSamples(PCM_source_transfer_t* block) {
 		block->samples_out=0;
-		if (block->midi_events) {
-			for (auto event = this->events.begin(); event != this->events.end(); ++event)
-				block->midi_events->AddItem(&*event);
-			this->events.clear();
+		if (!block->midi_events || block->samplerate <= 0) {
+			return;
+		}
+		const uint32_t current = this->currentBatch.load(memory_order_acquire);
+		const double blockLength = block->length / block->samplerate;
+		size_t tail = this->tail.load(memory_order_relaxed);
+		const size_t head = this->head.load(memory_order_acquire);
+		while (tail != head) {
+			const Event& event = this->ring[tail];
+			if ((int32_t)(event.batch - current) > 0) {
+				break; // Not published yet.
+			}
+			if (event.batch != current) {
+				// Superseded by a newer batch.
+				tail = (tail + 1) % RING_SIZE;
+				continue;
+			}
+			if (this->playingBatch != current) {
+				// This batch starts now.
+				this->playingBatch = current;
+				this->batchTime = 0.0;
+			}
+			if (event.time >= this->batchTime + blockLength) {
+				break; // Not due in this block.
+			}
+			MIDI_event_t midiEvent = {
+				max((int)((event.time - this->batchTime) * block->samplerate), 0), 3,
+				{event.message[0], event.message[1], event.message[2]}};
+			block->midi_events->AddItem(&midiEvent);
+			tail = (tail + 1) % RING_SIZE;
+		}
+		this->tail.store(tail, memory_order_release);
+		if (this->playingBatch == current) {
+			this->batchTime += blockLength;
+			if (tail == head) {
+				this->sentBatch.store(current, memory_order_release);
+			}
 		}
 	}
 
@@ -396,22 +757,54 @@ class PreviewSource : public PCM_source {
 	void PeaksBuild_Finish() {
 	}
 
+	private:
+	struct Event {
+		uint32_t batch;
+		// Seconds after the start of the batch.
+		double time;
+		unsigned char message[3];
+	};
+	// Enough for note ons and offs for every note on every channel with room to
+	// spare for a superseded batch.
+	static constexpr size_t RING_SIZE = 4096;
+	array<Event, RING_SIZE> ring;
+	// Written by the main thread.
+	atomic<size_t> head = 0;
+	// Written by the audio thread.
+	atomic<size_t> tail = 0;
+	// Only used by the main thread.
+	uint32_t nextBatch = 1;
+	// The latest batch published by the main thread.
+	atomic<uint32_t> currentBatch = 0;
+	// The latest batch whose events have all been sent by the audio thread.
+	atomic<uint32_t> sentBatch = 0;
+	// Only used by the audio thread.
+	uint32_t playingBatch = 0;
+	double batchTime = 0.0;
+	atomic<double> length = 0.0;
 };
 
 PreviewSource previewSource;
 preview_register_t previewReg = {0};
+// Whether note offs for previewingNotes have been queued and might not have
+// been sent yet.
+bool isNoteOffScheduled = false;
 
 // Queue note off events for the notes currently being previewed.
 // when sendNoteOff is true, this function  also sends the events.
 void previewNotesOff(bool sendNoteOff) {
+	if (sendNoteOff) {
+		previewSource.beginBatch();
+	}
 	for (auto note = previewingNotes.cbegin(); note != previewingNotes.cend(); ++note) {
-		MIDI_event_t event = {0, 3, {
+		const unsigned char message[3] = {
 			(unsigned char)(MIDI_NOTE_OFF | note->channel),
-			(unsigned char)note->pitch, (unsigned char)note->velocity}};
-		previewSource.events.push_back(event);
+			(unsigned char)note->pitch, (unsigned char)note->velocity};
+		previewSource.queue(message, 0.0);
 	}
 	if (sendNoteOff) {
 		// Send the events.
+		previewSource.publish();
 		previewReg.curpos = 0.0;
 		PlayTrackPreview(&previewReg);
 	}
@@ -437,37 +830,58 @@ void previewNotes(MediaItem_Take* take, const vector<MidiNote>& notes) {
 		previewReg.src = &previewSource;
 		previewReg.m_out_chan = -1; // Use .preview_track.
 	}
+	previewSource.beginBatch();
 	// Stop the current preview.
 	if (cancelPendingMidiPreviewNotesOff()) {
 		previewNotesOff(false);
+	} else {
+		// The audio thread already turned these off.
+		previewingNotes.clear();
 	}
 	// Queue note on events for the new notes.
 	for (auto const& note: notes) {
 		if (note.muted) {
 			continue;
 		}
-		MIDI_event_t event = {0, 3, {
+		const unsigned char message[3] = {
 			(unsigned char)(MIDI_NOTE_ON | note.channel),
-			(unsigned char)note.pitch, (unsigned char)note.velocity}};
-		previewSource.events.push_back(event);
+			(unsigned char)note.pitch, (unsigned char)note.velocity};
+		previewSource.queue(message, 0.0);
 		// Save the note being previewed so we can turn it off later (previewNotesOff).
 		previewingNotes.push_back(note);
 	}
+	if (!previewingNotes.empty()) {
+		// Calculate the minimum note length.
+		double minLength = min_element(previewingNotes.cbegin(), previewingNotes.cend(), compareNotesByLength)->getLength();
+		// Schedule note off messages. The audio thread sends these when they're
+		// due, so they're sample accurate and don't depend on the main thread.
+		const double offTime = minLength ? minLength :
+			DEFAULT_PREVIEW_LENGTH / 1000.0;
+		for (auto const& note: previewingNotes) {
+			const unsigned char message[3] = {
+				(unsigned char)(MIDI_NOTE_OFF | note.channel),
+				(unsigned char)note.pitch, (unsigned char)note.velocity};
+			previewSource.queue(message, offTime);
+		}
+		isNoteOffScheduled = true;
+	}
 	// Send the events.
+	previewSource.publish();
 	void* track = GetSetMediaItemTakeInfo(take, "P_TRACK", nullptr);
 	previewReg.preview_track = track;
 	previewReg.curpos = 0.0;
 	PlayTrackPreview(&previewReg);
-	// Calculate the minimum note length.
-	double minLength = min_element(previewingNotes.cbegin(), previewingNotes.cend(), compareNotesByLength)->getLength();
-	// Schedule note off messages.
-	previewDoneLater = CallLater([] {
-		previewNotesOff(true);
-	}, (UINT)(minLength ? minLength * 1000 : DEFAULT_PREVIEW_LENGTH));
 }
 
 bool cancelPendingMidiPreviewNotesOff() {
-	return previewDoneLater.cancel();
+	if (!isNoteOffScheduled) {
+		return false;
+	}
+	isNoteOffScheduled = false;
+	const bool pending = previewSource.isPending();
+	// Publishing an empty batch drops any events which haven't been sent.
+	previewSource.publish();
+	return pending;
 }
 
 // A random access iterator for MIDI events.
@@ -573,7 +987,8 @@ class MidiEventIterator {
 	mutable EventType currentValue;
 };
 
-using MidiNoteIterator = MidiEventIterator<MidiNote, MediaItem_Take*>;
+using MidiNoteIterator = MidiEventIterator<MidiNote,
+	shared_ptr<const MidiNoteSnapshot>>;
 
 const string getMidiNoteName(MediaTrack* track, int pitch, int channel) {
 	static const char* names[] = {
@@ -630,7 +1045,7 @@ pair<MidiNoteIterator, MidiNoteIterator> findChord(MediaItem_Take* take, int dir
 	// Ensure we always collect the start of the note since we need it to find chords.
 	reqParams.start = true;
 	double now = GetCursorPosition();
-	MidiNoteIterator begin(take, reqParams);
+	MidiNoteIterator begin(MidiNoteSnapshot::get(take), reqParams);
 	MidiNoteIterator end = begin;
 	end.moveToEnd();
 	if (begin == end) {
@@ -795,7 +1210,18 @@ vector<MidiNote> getSelectedNotes(MediaItem_Take* take, int offset=-1) {
 	return notes;
 }
 
-using MidiControlChangeIterator = MidiEventIterator<MidiControlChange, MediaItem_Take*>;
+using MidiControlChangeIterator = MidiEventIterator<MidiControlChange,
+	shared_ptr<const MidiControlChangeSnapshot>>;
+
+void selectCC(MediaItem_Take* take, const int cc, bool select=true) {
+	MIDI_SetCC(take, cc, &select, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+}
+
+bool isCCSelected(MediaItem_Take* take, const int cc) {
+	bool sel;
+	MIDI_GetCC(take, cc, &sel, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
+	return sel;
+}
 
 // #434: CC events are ordered arbitrarily and, unlike notes, order can change
 // when interacting with them. Therefore, when we are searching for the next
@@ -805,13 +1231,15 @@ using MidiControlChangeIterator = MidiEventIterator<MidiControlChange, MediaItem
 class SortedMidiControlChangeIterator {
 	public:
 	SortedMidiControlChangeIterator(MediaItem_Take* take):
-	begin(MidiControlChangeIterator(take, {
+	take(take),
+	// Selection is fetched in current(), since searching doesn't need it.
+	begin(MidiControlChangeIterator(MidiControlChangeSnapshot::get(take), {
 		true,  // position
 		true,  // message1
 		true,  // channel
 		true,  // message2
 		true,  // message3,
-		true,  // selected
+		false,  // selected
 		true  // muted
 	})),
 	// We'll set these properly below, but there's no default constructor, so we
@@ -896,7 +1324,9 @@ class SortedMidiControlChangeIterator {
 	MidiControlChange current() {
 		if (this->sortedIndexAtPos >= 0 &&
 				this->sortedIndexAtPos < this->sortedCCsAtPos.size()) {
-			return this->sortedCCsAtPos[this->sortedIndexAtPos];
+			MidiControlChange cc = this->sortedCCsAtPos[this->sortedIndexAtPos];
+			cc.selected = isCCSelected(this->take, cc.index);
+			return cc;
 		}
 		return {};
 	}
@@ -912,6 +1342,7 @@ class SortedMidiControlChangeIterator {
 			MidiControlChange::compareForSortAtPosition);
 	}
 
+	MediaItem_Take* take;
 	MidiControlChangeIterator begin;
 	MidiControlChangeIterator end;
 	// Points to the first CC at the current time position of this iterator.
@@ -952,44 +1383,149 @@ bool isCCInLane(const MidiControlChange& cc, int lane) {
 	return false;
 }
 
+// Returns the indices of all CCs at pos in the order used by
+// SortedMidiControlChangeIterator; i.e. the order in which currentCC counts.
+vector<int> getSortedCCsAt(const MidiControlChangeSnapshot& snapshot,
+	double pos
+) {
+	vector<int> indices;
+	for (int i = snapshot.findFirstAtOrAfter(pos);
+			i < snapshot.count() && snapshot.toTime(snapshot.position[i]) == pos;
+			++i) {
+		indices.push_back(i);
+	}
+	stable_sort(indices.begin(), indices.end(), [&snapshot](int a, int b) {
+		return MidiControlChange::compareForSortAtPosition(
+			MidiControlChange::getMessage(snapshot, a),
+			MidiControlChange::getMessage(snapshot, b));
+	});
+	return indices;
+}
+
+// The CCs in a single lane, sorted by position and then in the order used by
+// SortedMidiControlChangeIterator.
+struct MidiLaneIndex {
+	// In PPQ, as in the snapshot.
+	vector<double> positions;
+	vector<int> events;
+};
+
+// Lane indexes are built on demand for the current CC snapshot and discarded
+// when a new snapshot is taken. Neither holds selection, so moving between CCs
+// with OSARA's own commands (see MidiSelectionChange) keeps the index.
+const MidiLaneIndex& getMidiLaneIndex(
+	const shared_ptr<const MidiControlChangeSnapshot>& snapshot, int lane
+) {
+	static shared_ptr<const MidiControlChangeSnapshot> indexedSnapshot;
+	static map<int, MidiLaneIndex> laneIndexes;
+	if (snapshot != indexedSnapshot) {
+		laneIndexes.clear();
+		indexedSnapshot = snapshot;
+	}
+	auto [it, inserted] = laneIndexes.try_emplace(lane);
+	MidiLaneIndex& index = it->second;
+	if (!inserted) {
+		return index;
+	}
+	for (int i = 0; i < snapshot->count(); ++i) {
+		if (isCCInLane(MidiControlChange::getMessage(*snapshot, i), lane)) {
+			index.events.push_back(i);
+		}
+	}
+	const MidiControlChangeSnapshot& snap = *snapshot;
+	stable_sort(index.events.begin(), index.events.end(), [&snap](int a, int b) {
+		if (snap.position[a] != snap.position[b]) {
+			return snap.position[a] < snap.position[b];
+		}
+		return MidiControlChange::compareForSortAtPosition(
+			MidiControlChange::getMessage(snap, a),
+			MidiControlChange::getMessage(snap, b));
+	});
+	index.positions.reserve(index.events.size());
+	for (int event : index.events) {
+		index.positions.push_back(snap.position[event]);
+	}
+	return index;
+}
+
 // Finds a single CC at the cursor in a given direction and returns its info.
 // This updates currentCC.
 MidiControlChange findCC(MediaItem_Take* take, int direction) {
+	if (direction == 0) {
+		SortedMidiControlChangeIterator iter(take);
+		MidiControlChange cc = iter.current();
+		if (cc) {
+			iter.updateCurrentCC();
+		}
+		return cc;
+	}
 	HWND editor = MIDIEditor_GetActive();
 	int lane = MIDIEditor_GetSetting_int(editor, "last_clicked_cc_lane");
-	SortedMidiControlChangeIterator iter(take);
-	MidiControlChange cc;
-	if (direction == -1) {
-		while ((cc = iter.previous())) {
-			if (isCCInLane(cc, lane)) {
+	auto snapshot = MidiControlChangeSnapshot::get(take);
+	const MidiLaneIndex& laneIndex = getMidiLaneIndex(snapshot, lane);
+	const double now = GetCursorPosition();
+	// The number of the CC we're on at the cursor in the sorted order of all
+	// CCs at the cursor, or -1 if we're not on one.
+	auto [position, curCC] = currentCC;
+	if (position != now) {
+		curCC = -1;
+	}
+	vector<int> sortedAtNow = getSortedCCsAt(*snapshot, now);
+	if (curCC >= (int)sortedAtNow.size()) {
+		curCC = -1;
+	}
+	auto rankAtNow = [&sortedAtNow](int event) {
+		return (int)(find(sortedAtNow.begin(), sortedAtNow.end(), event) -
+			sortedAtNow.begin());
+	};
+	const int laneCount = (int)laneIndex.events.size();
+	// Compare in project time. See MidiControlChangeSnapshot::findFirstAtOrAfter.
+	int firstAtNow = (int)(lower_bound(laneIndex.positions.begin(),
+		laneIndex.positions.end(), now, [&snapshot](double ppq, double pos) {
+			return snapshot->toTime(ppq) < pos;
+		}) - laneIndex.positions.begin());
+	int firstAfterNow = (int)(upper_bound(laneIndex.positions.begin(),
+		laneIndex.positions.end(), now, [&snapshot](double pos, double ppq) {
+			return pos < snapshot->toTime(ppq);
+		}) - laneIndex.positions.begin());
+	int found = -1;
+	if (direction == 1) {
+		// The next CC in this lane at the cursor, otherwise the first after it.
+		for (int i = firstAtNow; i < firstAfterNow; ++i) {
+			if (rankAtNow(laneIndex.events[i]) > curCC) {
+				found = i;
 				break;
 			}
 		}
-	} else if (direction == 1) {
-		while ((cc = iter.next())) {
-			if (isCCInLane(cc, lane)) {
-				break;
-			}
+		if (found == -1 && firstAfterNow < laneCount) {
+			found = firstAfterNow;
 		}
 	} else {
-		cc = iter.current();
+		// The previous CC in this lane at the cursor, otherwise the last before it.
+		if (curCC != -1) {
+			for (int i = firstAfterNow - 1; i >= firstAtNow; --i) {
+				if (rankAtNow(laneIndex.events[i]) < curCC) {
+					found = i;
+					break;
+				}
+			}
+		}
+		if (found == -1 && firstAtNow > 0) {
+			found = firstAtNow - 1;
+		}
 	}
-	if (cc) {
-		iter.updateCurrentCC();
+	if (found == -1) {
+		return {};
 	}
+	MidiControlChange cc = MidiControlChange::get(*snapshot,
+		laneIndex.events[found]);
+	vector<int> sortedAtPos = cc.position == now ? sortedAtNow :
+		getSortedCCsAt(*snapshot, cc.position);
+	currentCC = {cc.position, (int)(find(sortedAtPos.begin(), sortedAtPos.end(),
+		cc.index) - sortedAtPos.begin())};
 	return cc;
 }
 
-void selectCC(MediaItem_Take* take, const int cc, bool select=true) {
-	MIDI_SetCC(take, cc, &select, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
-}
-
-bool isCCSelected(MediaItem_Take* take, const int cc) {
-	bool sel;
-	MIDI_GetCC(take, cc, &sel, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr);
-	return sel;
-}
-
 vector<MidiControlChange> getSelectedCCs(MediaItem_Take* take, int offset=-1) {
 	int ccIndex = offset;
 	vector<MidiControlChange> ccs;
@@ -1015,6 +1551,7 @@ void cmdMidiToggleSelection(Command* command) {
 	}
 	HWND editor = MIDIEditor_GetActive();
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
+	MidiSelectionChange selectionChange(take);
 	bool select;
 	switch (fakeFocus) {
 		case FOCUS_NOTE: {
@@ -1076,6 +1613,7 @@ void moveToChord(int direction, bool clearSelection=true, bool select=true) {
 		return;
 	}
 	curNoteInChord = -1;
+	MidiSelectionChange selectionChange(take);
 	if (clearSelection) {
 		MIDIEditor_OnCommand(editor, 40214); // Edit: Unselect all
 		isSelectionContiguous = true;
@@ -1155,6 +1693,7 @@ void moveToNoteInChord(int direction, bool clearSelection=true, bool select=true
 	if (note.channel == -1) {
 		return;
 	}
+	MidiSelectionChange selectionChange(take);
 	if (clearSelection) {
 		MIDIEditor_OnCommand(editor, 40214); // Edit: Unselect all
 		isSelectionContiguous = true;
@@ -1519,6 +2058,7 @@ void moveToCC(int direction, bool clearSelection=true, bool select=true) {
 	if (!cc) {
 		return;
 	}
+	MidiSelectionChange selectionChange(take);
 	if (clearSelection || select) {
 		Undo_BeginBlock();
 	}
@@ -1592,15 +2132,7 @@ void midiMoveToItem(int direction) {
 	MediaItem_Take* take = MIDIEditor_GetTake(editor);
 	MediaItem* item = GetMediaItemTake_Item(take);
 	MediaTrack* track = GetMediaItem_Track(item);
-	int count = CountTrackMediaItems(track);
-	int itemNum = 1;
-	for (int i=0; i<count; ++i) {
-		MediaItem* itemTmp = GetTrackMediaItem(track, i);
-		if (itemTmp == item) {
-			itemNum = i+1;
-			break;
-		}
-	}
+	int itemNum = max(TrackItemIndex::get(track).indexOf(item), 0) + 1;
 	fakeFocus = FOCUS_ITEM;
 	ostringstream s;
 	s << itemNum << " " << GetTakeName(take);
@@ -1667,6 +2199,7 @@ void cmdMidiSelectSamePitchStartingInTimeSelection(Command* command) {
 	}
 	int selPitch;
 	MIDI_GetNote(take, selNote, nullptr, nullptr, nullptr, nullptr, nullptr, &selPitch, nullptr);
+	MidiSelectionChange selectionChange(take);
 	Undo_BeginBlock();
 	MIDIEditor_OnCommand(editor, 40214); // Edit: Unselect all
 	int noteCount {0}, selectCount {0};
@@ -2313,8 +2846,7 @@ void postMidiChangeZoom(int command) {
 	//the zoom is in pixels per midi tick. we need to convert it to pixels per beat.
 	if(GetToggleCommandState2(SectionFromUniqueID(MIDI_EDITOR_SECTION), 40459) == 1 // Timebase: Beats (project)
 		|| GetToggleCommandState2(SectionFromUniqueID(MIDI_EDITOR_SECTION), 40470) == 1) { // Timebase: Beats (source)
-		MediaItem* item = GetMediaItemTake_Item(take);
-		zoom *= getItemPPQ(item);
+		zoom *= getTakePPQ(take);
 		// Translators: Reported when zooming in or out horizontally. {} will be
 		// replaced with the number of pixels per beat; e.g. 100 pixels/beat.
 		outputMessage(format(translate("{} pixels/beat"), formatDouble(zoom, 1)));
@@ -22,7 +22,7 @@ void previewNotesOff(bool sendNoteOff=true);
 // Returns true when previewDoneTimer was set at the time of calling the function, false otherwise.
 bool cancelPendingMidiPreviewNotesOff();
 
-int getItemPPQ(MediaItem* item);
+int getTakePPQ(MediaItem_Take* take);
 
 void cmdMidiMoveCursor(Command* command);
 void cmdMidiToggleSelection(Command* command);
@@ -103,6 +103,7 @@
 #define REAPERAPI_WANT_MIDIEditor_GetTake
 #define REAPERAPI_WANT_MIDIEditor_GetSetting_str
 #define REAPERAPI_WANT_MIDI_CountEvts
+#define REAPERAPI_WANT_MIDI_GetHash
 #define REAPERAPI_WANT_MIDI_GetNote
 #define REAPERAPI_WANT_MIDI_SetNote
 #define REAPERAPI_WANT_MIDI_GetCC
@@ -163,6 +164,7 @@
 #define REAPERAPI_WANT_SetMediaTrackInfo_Value
 #define REAPERAPI_WANT_MIDI_EnumSelEvts
 #define REAPERAPI_WANT_GetMediaItemTake_Item
+#define REAPERAPI_WANT_GetMediaItemTake_Source
 #define REAPERAPI_WANT_GetMediaItem_Track
 #define REAPERAPI_WANT_IsMediaItemSelected
 #define REAPERAPI_WANT_GetMediaItemInfo_Value
@@ -221,6 +223,8 @@
 #define REAPERAPI_WANT_parse_timestr_len
 #define REAPERAPI_WANT_TimeMap_GetTimeSigAtTime
 #define REAPERAPI_WANT_GetSetProjectGrid
+#define REAPERAPI_WANT_TrackFX_GetFXGUID
+#define REAPERAPI_WANT_GetProjectStateChangeCount
 
 #include <reaper/reaper_plugin.h>
 #include <reaper/reaper_plugin_functions.h>
@@ -271,8 +275,45 @@ extern bool shouldMoveToAutoItem;
 extern int lastCommand;
 
 bool shouldReportTimeMovement() ;
+// Call this when the mute, solo, etc. state of a track might have changed
+// without changing the project state change count.
+void invalidateTrackStateSnapshot();
 void outputMessage(const std::string& message, bool interrupt = true);
 void outputMessage(std::ostringstream& message, bool interrupt = true);
+// Show a message in a dialog which can be reviewed with the cursor.
+void reviewMessage(const char* title, const char* message);
+
+// Sources of messages which can be queued rather than output immediately.
+// These are in priority order; i.e. when several sources have a message
+// pending, they are output in this order.
+enum OutputSource {
+	OUTPUT_SURFACE_VOLUME,
+	OUTPUT_SURFACE_PAN,
+	OUTPUT_SCRUB,
+	OUTPUT_PEAK_WATCHER,
+	OUTPUT_NUM_SOURCES
+};
+// Queue a message to be output on the next call to flushOutputQueue(). This
+// should be used for messages which can be produced many times a second; e.g.
+// when a key is held or a control surface fader is moved. A newer message
+// replaces a pending message from the same source, so the screen reader only
+// has to speak the latest. context is output before message. If the pending
+// message had context and the new one doesn't, the pending context is kept so
+// that information such as the track name isn't lost. If minInterval is
+// non-zero, messages from this source won't be output more often than every
+// minInterval ms.
+void queueMessage(OutputSource source, const std::string& message,
+	bool interrupt = true, const std::string& context = "",
+	DWORD minInterval = 0);
+// Like queueMessage, but the message is only produced by calling getMessage
+// when it is actually output. This should be used when producing the message
+// has side effects, such as formatting a time using the cache, which would be
+// wrong for messages which get replaced before they are output.
+void queueMessage(OutputSource source, std::function<std::string()> getMessage,
+	bool interrupt = true, const std::string& context = "",
+	DWORD minInterval = 0);
+// Output any queued messages which are due. This is called once per UI frame.
+void flushOutputQueue();
 
 // Call a function or lambda (even a lambda with capture) asynchronously after
 // the specified number of ms. The function must take no parameters and return
@@ -357,6 +398,9 @@ bool terminateUia();
 bool shouldUseUiaNotifications();
 bool sendUiaNotification(const std::string& message, bool interrupt = true);
 void resetUia();
+// reaper_osara.cpp
+// Output a message immediately, bypassing the output queue and muting.
+void _outputMessage(const std::string& message, bool interrupt);
 
 #else
 // These macros exist on Windows but aren't defined by Swell for Mac.
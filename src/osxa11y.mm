@@ -1,8 +1,9 @@
 #import <AppKit/AppKit.h>
+#include <string>
 #include "osxa11y_wrapper.h"
 
 @interface OSXA11y : NSObject
-- (void)announce:(NSString*)message;
+- (void)announce:(NSString*)message interrupt:(BOOL)interrupt;
 @end
 
 @implementation OSXA11y
@@ -10,6 +11,11 @@ namespace NSA11yWrapper {
   struct osxa11yImpl
   {
     OSXA11y* pWrapper;
+    // Messages output during a single run loop pass are combined into one
+    // announcement, posted when the run loop next gets a chance.
+    std::string pending;
+    bool pendingInterrupt = false;
+    bool isFlushScheduled = false;
   };
 
   void init()
@@ -18,22 +24,53 @@ namespace NSA11yWrapper {
     impl->pWrapper = [[OSXA11y alloc] init];
   }
 
-  void osxa11y_announce(const std::string& message)
+  void flush()
   {
-    NSString* param = [NSString stringWithUTF8String:message.c_str()];
-    [impl->pWrapper announce:param];
+    impl->isFlushScheduled = false;
+    if (impl->pending.empty())
+      return;
+    NSString* param = [NSString stringWithUTF8String:impl->pending.c_str()];
+    [impl->pWrapper announce:param interrupt:impl->pendingInterrupt];
+    impl->pending.clear();
+    impl->pendingInterrupt = false;
+  }
+
+  void osxa11y_announce(const std::string& message, bool interrupt)
+  {
+    if (message.empty())
+      return;
+    if (interrupt) {
+      // This supersedes anything we haven't announced yet.
+      impl->pending = message;
+      impl->pendingInterrupt = true;
+    } else {
+      if (!impl->pending.empty())
+        impl->pending += ", ";
+      impl->pending += message;
+    }
+    if (!impl->isFlushScheduled) {
+      impl->isFlushScheduled = true;
+      dispatch_async(dispatch_get_main_queue(), ^{
+        if (impl != nullptr)
+          flush();
+      });
+    }
   }
 
   void destroy()
   {
-    if (impl != nullptr)
+    if (impl != nullptr) {
       delete impl;
+      impl = nullptr;
+    }
   }    
 }
 
-- (void)announce:(NSString*)message {
+- (void)announce:(NSString*)message interrupt:(BOOL)interrupt {
+  // High priority announcements interrupt whatever VoiceOver is saying. Others
+  // wait their turn.
   NSDictionary *announcementInfo = @{NSAccessibilityAnnouncementKey : message,
-				     NSAccessibilityPriorityKey : @(NSAccessibilityPriorityHigh)};
+				     NSAccessibilityPriorityKey : @(interrupt ? NSAccessibilityPriorityHigh : NSAccessibilityPriorityMedium)};
 
   NSAccessibilityPostNotificationWithUserInfo([NSApp keyWindow], NSAccessibilityAnnouncementRequestedNotification, announcementInfo);
 }
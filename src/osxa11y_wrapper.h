@@ -7,7 +7,10 @@ namespace NSA11yWrapper {
   static osxa11yImpl* impl;
 
   void init();
-  void osxa11y_announce(const std::string& param);
+  // Announcements are batched and posted on the next run loop pass. If
+  // interrupt is true, this replaces any announcement which hasn't been posted
+  // yet.
+  void osxa11y_announce(const std::string& param, bool interrupt = true);
   void destroy();
 }
  
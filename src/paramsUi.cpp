@@ -6,11 +6,13 @@
  */
 
 #include <string>
+#include <string_view>
 #include <sstream>
 #include <vector>
 #include <algorithm>
 #include <functional>
 #include <iomanip>
+#include <map>
 #include <memory>
 #include <regex>
 // osara.h includes windows.h, which must be included before other Windows
@@ -27,6 +29,7 @@
 #include <reaper/reaper_plugin.h>
 #include "config.h"
 #include "fxChain.h"
+#include "fxTree.h"
 #include "resource.h"
 #include "translation.h"
 
@@ -290,6 +293,66 @@ const char CFGKEY_DIALOG_POS[] = "paramsDialogPos";
 
 bool isParamsDialogOpen = false;
 
+// The names of all parameters in a ParamSource. Fetching a name can mean a
+// call into a plugin, which adds up for plugins with thousands of parameters,
+// so names are fetched once and kept along with a lower case copy for
+// filtering. Both copies are kept in contiguous buffers to avoid an allocation
+// per parameter.
+class ParamNameIndex {
+	public:
+	void build(ParamSource& source) {
+		// Matches names which are just a number or placeholder, as well as the
+		// parameter number we append.
+		static const regex RE_UNNAMED_PARAM{
+			"(?:|-|\\d{1,4} -|[P#]\\d{3}) \\(\\d+\\)"};
+		int count = source.getParamCount();
+		this->names.clear();
+		this->lowerNames.clear();
+		this->offsets.clear();
+		this->offsets.reserve(count + 1);
+		this->unnamed.clear();
+		this->unnamed.reserve(count);
+		for (int p = 0; p < count; ++p) {
+			this->offsets.push_back(this->names.size());
+			const string name = source.getParamName(p);
+			this->names += name;
+			this->unnamed.push_back(regex_match(name, RE_UNNAMED_PARAM));
+		}
+		this->offsets.push_back(this->names.size());
+		this->lowerNames = this->names;
+		transform(this->lowerNames.begin(), this->lowerNames.end(),
+			this->lowerNames.begin(), ::tolower);
+	}
+
+	int count() const {
+		return (int)this->unnamed.size();
+	}
+
+	string getName(int param) const {
+		return this->names.substr(this->offsets[param],
+			this->offsets[param + 1] - this->offsets[param]);
+	}
+
+	bool isUnnamed(int param) const {
+		return this->unnamed[param];
+	}
+
+	// filter must already be lower case.
+	bool matches(int param, const string& filter) const {
+		return string_view(this->lowerNames).substr(this->offsets[param],
+			this->offsets[param + 1] - this->offsets[param]).find(filter) !=
+			string_view::npos;
+	}
+
+	private:
+	string names;
+	string lowerNames;
+	// The start of each name in the buffers. There is an extra offset at the end
+	// so that the end of a name is always the start of the next.
+	vector<size_t> offsets;
+	vector<bool> unnamed;
+};
+
 class ParamsDialog {
 	private:
 	unique_ptr<ParamSource> source;
@@ -300,6 +363,10 @@ class ParamsDialog {
 	HWND valueLabel;
 	HWND moreButton;
 	string filter;
+	ParamNameIndex names;
+	// The params which match filter, regardless of whether unnamed params are
+	// shown. When the filter text is extended, only these need to be searched.
+	vector<int> filteredParams;
 	vector<int> visibleParams;
 	int paramNum;
 	unique_ptr<Param> param;
@@ -598,20 +665,38 @@ class ParamsDialog {
 		}
 	}
 
-	const regex RE_UNNAMED_PARAM{"(?:|-|\\d{1,4} -|[P#]\\d{3}) \\(\\d+\\)"};
-	bool shouldIncludeParam(string name) {
-		if (!IsDlgButtonChecked(this->dialog, ID_PARAM_UNNAMED)) {
-			smatch m;
-			regex_match(name, m, RE_UNNAMED_PARAM);
-			if (!m.empty()) {
-				return false;
+	// Update filteredParams for a new filter. If the new filter contains the old
+	// one, anything which matches the new filter must also have matched the old
+	// one, so we only need to search the previous matches.
+	void applyFilter(const string& newFilter) {
+		const bool narrowing = this->filter.empty() ||
+			newFilter.find(this->filter) != string::npos;
+		this->filter = newFilter;
+		if (narrowing) {
+			erase_if(this->filteredParams, [this](int p) {
+				return !this->names.matches(p, this->filter);
+			});
+			return;
+		}
+		this->filteredParams.clear();
+		for (int p = 0; p < this->names.count(); ++p) {
+			if (this->names.matches(p, this->filter)) {
+				this->filteredParams.push_back(p);
 			}
 		}
-		if (filter.empty())
-			return true;
-		// Convert param name to lower case for match.
-		transform(name.begin(), name.end(), name.begin(), ::tolower);
-		return name.find(filter) != string::npos;
+	}
+
+	// Rebuild the name index and the filter results from the source. This must
+	// be called whenever the source's params change.
+	void rebuildNames() {
+		this->names.build(*this->source);
+		this->filteredParams.resize(this->names.count());
+		for (int p = 0; p < this->names.count(); ++p) {
+			this->filteredParams[p] = p;
+		}
+		const string newFilter = this->filter;
+		this->filter.clear();
+		this->applyFilter(newFilter);
 	}
 
 	void updateParamList() {
@@ -621,18 +706,30 @@ class ParamsDialog {
 		else
 			prevSelParam = this->visibleParams[ComboBox_GetCurSel(this->paramCombo)];
 		this->visibleParams.clear();
+		const bool includeUnnamed = IsDlgButtonChecked(this->dialog,
+			ID_PARAM_UNNAMED);
+		for (int p: this->filteredParams) {
+			if (includeUnnamed || !this->names.isUnnamed(p)) {
+				this->visibleParams.push_back(p);
+			}
+		}
 		// Use the first item if the previously selected param gets filtered out.
 		int newComboSel = 0;
+		// Fill the combo box in one batch rather than redrawing it for every
+		// item.
+		SendMessage(this->paramCombo, WM_SETREDRAW, FALSE, 0);
 		ComboBox_ResetContent(this->paramCombo);
-		for (int p = 0; p < this->source->getParamCount(); ++p) {
-			const string name = source->getParamName(p);
-			if (!this->shouldIncludeParam(name))
-				continue;
-			this->visibleParams.push_back(p);
-			ComboBox_AddString(this->paramCombo, name.c_str());
+#ifdef _WIN32
+		SendMessage(this->paramCombo, CB_INITSTORAGE, this->visibleParams.size(),
+			0);
+#endif
+		for (size_t i = 0; i < this->visibleParams.size(); ++i) {
+			int p = this->visibleParams[i];
+			ComboBox_AddString(this->paramCombo, this->names.getName(p).c_str());
 			if (p == prevSelParam)
-				newComboSel = (int)this->visibleParams.size() - 1;
+				newComboSel = (int)i;
 		}
+		SendMessage(this->paramCombo, WM_SETREDRAW, TRUE, 0);
 		ComboBox_SetCurSel(this->paramCombo, newComboSel);
 		if (this->visibleParams.empty()) {
 			EnableWindow(this->slider, FALSE);
@@ -650,7 +747,7 @@ class ParamsDialog {
 		transform(text.begin(), text.end(), text.begin(), ::tolower);
 		if (this->filter.compare(text) == 0)
 			return; // No change.
-		this->filter = text;
+		this->applyFilter(text);
 		this->updateParamList();
 	}
 
@@ -682,6 +779,7 @@ class ParamsDialog {
 			this->onParamChange();
 		} else if (after == Param::AfterOption::invalidateParams) {
 			this->source->rebuildParams();
+			this->rebuildNames();
 			this->updateParamList();
 		} else {
 			SendMessage(this->dialog, WM_CLOSE, 0, 0);
@@ -724,6 +822,7 @@ class ParamsDialog {
 		this->valueLabel = GetDlgItem(this->dialog, ID_PARAM_VAL_LABEL);
 		this->moreButton = GetDlgItem(this->dialog, ID_PARAM_MORE);
 		CheckDlgButton(this->dialog, ID_PARAM_UNNAMED, BST_CHECKED);
+		this->rebuildNames();
 		this->updateParamList();
 		this->restoreWindowPos();
 		ShowWindow(this->dialog, SW_SHOWNORMAL);
@@ -741,20 +840,13 @@ class FxParam;
 template<typename ReaperObj>
 class FxNamedConfigParam;
 
+// The FX API functions for a prefix (TrackFX/TakeFX). Resolving these means
+// building each name and looking it up, so it is only done once per prefix.
 template<typename ReaperObj>
-class FxParams: public ParamSource {
-	friend class FxParam<ReaperObj>;
-	friend class FxNamedConfigParam<ReaperObj>;
-
-	private:
-	ReaperObj* obj;
-	int fx;
-	// Named config params can't be enumerated, so we have to build a list of
-	// these based on the effect and the known named parameters it supports. See
-	// initNamedConfigParams().
-	vector<FxNamedConfigParam<ReaperObj>> namedConfigParams;
+struct FxFunctions {
 	int (*_GetNumParams)(ReaperObj*, int);
 	bool (*_GetFXName)(ReaperObj*, int, char*, int);
+	GUID* (*_GetFXGUID)(ReaperObj*, int);
 	bool (*_GetParamName)(ReaperObj*, int, int, char*, int);
 	double (*_GetParam)(ReaperObj*, int, int, double*, double*);
 	bool (*_GetParameterStepSizes)(ReaperObj*, int, int, double*, double*,
@@ -764,26 +856,125 @@ class FxParams: public ParamSource {
 	bool (*_GetNamedConfigParm)(ReaperObj*, int, const char*, char*, int);
 	bool (*_SetNamedConfigParm)(ReaperObj*, int, const char*, const char*);
 
+	static const FxFunctions& get(const string& apiPrefix) {
+		static map<string, FxFunctions> cache;
+		auto [it, inserted] = cache.try_emplace(apiPrefix);
+		FxFunctions& f = it->second;
+		if (!inserted) {
+			return f;
+		}
+		*(void**)&f._GetNumParams = plugin_getapi((apiPrefix + "_GetNumParams").c_str());
+		*(void**)&f._GetFXName = plugin_getapi(
+			(apiPrefix + "_GetFXName").c_str());
+		*(void**)&f._GetFXGUID = plugin_getapi(
+			(apiPrefix + "_GetFXGUID").c_str());
+		*(void**)&f._GetParamName = plugin_getapi((apiPrefix + "_GetParamName").c_str());
+		*(void**)&f._GetParam = plugin_getapi((apiPrefix + "_GetParam").c_str());
+		*(void**)&f._GetParameterStepSizes = plugin_getapi((apiPrefix +
+			"_GetParameterStepSizes").c_str());
+		*(void**)&f._SetParam = plugin_getapi((apiPrefix + "_SetParam").c_str());
+		*(void**)&f._FormatParamValue = plugin_getapi((apiPrefix + "_FormatParamValue").c_str());
+		*(void**)&f._GetNamedConfigParm = plugin_getapi(
+			(apiPrefix + "_GetNamedConfigParm").c_str());
+		*(void**)&f._SetNamedConfigParm = plugin_getapi(
+			(apiPrefix + "_SetNamedConfigParm").c_str());
+		return f;
+	}
+};
+
+// Parameter info for an FX. Fetching this means calls into the plugin for
+// every parameter, which is slow for plugins with thousands of parameters, so
+// it is kept between visits to the parameters dialog. Entries are keyed by FX
+// GUID and are discarded whenever FX are added, removed or reordered. Some
+// plugins (e.g. samplers) change their parameters without changing the
+// count, so an entry is also discarded if its signature no longer matches.
+struct FxParamsMetadata {
+	struct ParamInfo {
+		bool hasName = false;
+		string name;
+		bool hasRange = false;
+		double min;
+		double max;
+		double step;
+		double largeStep;
+	};
+	vector<ParamInfo> params;
+	// The FX name and the names of its first and last parameters. This is cheap
+	// to fetch and catches plugins which replace their parameters.
+	string signature;
+	// The number of ReaEQ bands exposed as named config params, or -1 if we
+	// haven't checked yet.
+	int reaEqBands = -1;
+};
+
+map<string, shared_ptr<FxParamsMetadata>> fxParamsMetadataCache;
+
+void invalidateFxParamsCache() {
+	fxParamsMetadataCache.clear();
+}
+
+template<typename ReaperObj>
+class FxParams: public ParamSource, private FxFunctions<ReaperObj> {
+	friend class FxParam<ReaperObj>;
+	friend class FxNamedConfigParam<ReaperObj>;
+
+	private:
+	ReaperObj* obj;
+	int fx;
+	// The metadata for fx. This is null if fx is -1.
+	shared_ptr<FxParamsMetadata> metadata;
+	// Named config params can't be enumerated, so we have to build a list of
+	// these based on the effect and the known named parameters it supports. See
+	// initNamedConfigParams().
+	vector<FxNamedConfigParam<ReaperObj>> namedConfigParams;
+
 	void initNamedConfigParams();
 
+	// Get the cached metadata for an FX, creating it if necessary.
+	shared_ptr<FxParamsMetadata> getMetadata(int fx) {
+		if (fx == this->fx && this->metadata) {
+			return this->metadata;
+		}
+		GUID* guid = this->_GetFXGUID(this->obj, fx);
+		if (!guid) {
+			return make_shared<FxParamsMetadata>();
+		}
+		auto& metadata = fxParamsMetadataCache[
+			string((const char*)guid, sizeof(GUID))];
+		int count = this->_GetNumParams(this->obj, fx);
+		string signature = this->getSignature(fx, count);
+		// Some plugins change their parameters; e.g. when a different sound is
+		// loaded. If that happened, throw away what we knew.
+		if (!metadata || (int)metadata->params.size() != count ||
+				metadata->signature != signature) {
+			metadata = make_shared<FxParamsMetadata>();
+			metadata->params.resize(count);
+			metadata->signature = signature;
+		}
+		return metadata;
+	}
+
+	string getSignature(int fx, int count) {
+		char name[256] = "";
+		this->_GetFXName(this->obj, fx, name, sizeof(name));
+		string signature = name;
+		if (count > 0) {
+			this->_GetParamName(this->obj, fx, 0, name, sizeof(name));
+			signature += '\n';
+			signature += name;
+			this->_GetParamName(this->obj, fx, count - 1, name, sizeof(name));
+			signature += '\n';
+			signature += name;
+		}
+		return signature;
+	}
+
 	public:
 	FxParams(ReaperObj* obj, const string& apiPrefix, int fx=-1):
+			FxFunctions<ReaperObj>(FxFunctions<ReaperObj>::get(apiPrefix)),
 			obj(obj), fx(fx) {
-		// Get functions.
-		*(void**)&this->_GetNumParams = plugin_getapi((apiPrefix + "_GetNumParams").c_str());
-		*(void**)&this->_GetFXName = plugin_getapi(
-			(apiPrefix + "_GetFXName").c_str());
-		*(void**)&this->_GetParamName = plugin_getapi((apiPrefix + "_GetParamName").c_str());
-		*(void**)&this->_GetParam = plugin_getapi((apiPrefix + "_GetParam").c_str());
-		*(void**)&this->_GetParameterStepSizes = plugin_getapi((apiPrefix +
-			"_GetParameterStepSizes").c_str());
-		*(void**)&this->_SetParam = plugin_getapi((apiPrefix + "_SetParam").c_str());
-		*(void**)&this->_FormatParamValue = plugin_getapi((apiPrefix + "_FormatParamValue").c_str());
-		*(void**)&this->_GetNamedConfigParm = plugin_getapi(
-			(apiPrefix + "_GetNamedConfigParm").c_str());
-		*(void**)&this->_SetNamedConfigParm = plugin_getapi(
-			(apiPrefix + "_SetNamedConfigParm").c_str());
 		if (fx >= 0) {
+			this->metadata = this->getMetadata(fx);
 			this->initNamedConfigParams();
 		}
 	}
@@ -802,10 +993,15 @@ class FxParams: public ParamSource {
 		if (param < namedCount) {
 			ns << this->namedConfigParams[param].getDisplayName();
 		} else {
-			char name[256];
-			this->_GetParamName(this->obj, this->fx, param - namedCount, name,
-				sizeof(name));
-			ns << name;
+			auto& info = this->metadata->params[param - namedCount];
+			if (!info.hasName) {
+				char name[256];
+				this->_GetParamName(this->obj, this->fx, param - namedCount, name,
+					sizeof(name));
+				info.name = name;
+				info.hasName = true;
+			}
+			ns << info.name;
 		}
 		// Append the parameter number to facilitate efficient navigation
 		// and to ensure reporting where two consecutive parameters have the same name (#32).
@@ -834,13 +1030,40 @@ class FxParam: public Param {
 	public:
 	FxParam(FxParams<ReaperObj>& source, int fx, int param):
 			Param(), source(source), fx(fx), param(param) {
-		source._GetParam(source.obj, fx, param, &this->min, &this->max);
+		auto metadata = source.getMetadata(fx);
+		FxParamsMetadata::ParamInfo dummy;
+		auto& info = param < (int)metadata->params.size() ?
+			metadata->params[param] : dummy;
+		if (info.hasRange) {
+			this->min = info.min;
+			this->max = info.max;
+			this->step = info.step;
+			this->largeStep = info.largeStep;
+		} else {
+			this->fetchRange();
+			info.min = this->min;
+			info.max = this->max;
+			info.step = this->step;
+			info.largeStep = this->largeStep;
+			info.hasRange = true;
+		}
+		this->isEditable = true;
+		// Set this as the last touched FX and FX parameter, as well as the last
+		// focused FX.
+		string paramStr = format("{}", param);
+		source._SetNamedConfigParm(source.obj, fx, "last_touched", paramStr.c_str());
+		source._SetNamedConfigParm(source.obj, fx, "focused", "1");
+	}
+
+	void fetchRange() {
+		this->source._GetParam(this->source.obj, this->fx, this->param, &this->min,
+			&this->max);
 		// *FX_GetParameterStepSizes doesn't set these to 0 if it can't fetch them,
 		// even if it returns true.
 		this->step = 0;
 		this->largeStep = 0;
-		source._GetParameterStepSizes(source.obj, fx, param, &this->step, nullptr,
-			&this->largeStep, nullptr);
+		this->source._GetParameterStepSizes(this->source.obj, this->fx,
+			this->param, &this->step, nullptr, &this->largeStep, nullptr);
 		if (this->step) {
 			if (!this->largeStep) {
 				this->largeStep = (this->max - this->min) / 50;
@@ -854,12 +1077,6 @@ class FxParam: public Param {
 			this->step = (this->max - this->min) / 1000;
 			this->largeStep = this->step * 20;
 		}
-		this->isEditable = true;
-		// Set this as the last touched FX and FX parameter, as well as the last
-		// focused FX.
-		string paramStr = format("{}", param);
-		source._SetNamedConfigParm(source.obj, fx, "last_touched", paramStr.c_str());
-		source._SetNamedConfigParm(source.obj, fx, "focused", "1");
 	}
 
 	double getValue() final {
@@ -974,34 +1191,42 @@ const FxNamedConfigParamValues REAEQ_BAND_TYPE_VALUES = {
 
 template<typename ReaperObj>
 void FxParams<ReaperObj>::initNamedConfigParams() {
-	char fxName[50];
-	this->_GetFXName(this->obj, this->fx, fxName, sizeof(fxName));
-	if (strcmp(fxName, "VST: ReaEQ (Cockos)") == 0) {
-		for (int band = 0; ; ++band) {
-			ostringstream name;
-			name << "BANDENABLED" << band;
-			char type[2];
-			if (!this->_GetNamedConfigParm(this->obj, this->fx, name.str().c_str(),
-					type, sizeof(type))) {
-				// This band doesn't exist.
-				break;
+	int& bands = this->metadata->reaEqBands;
+	if (bands == -1) {
+		bands = 0;
+		char fxName[50];
+		this->_GetFXName(this->obj, this->fx, fxName, sizeof(fxName));
+		if (strcmp(fxName, "VST: ReaEQ (Cockos)") == 0) {
+			for (; ; ++bands) {
+				ostringstream name;
+				name << "BANDENABLED" << bands;
+				char type[2];
+				if (!this->_GetNamedConfigParm(this->obj, this->fx,
+						name.str().c_str(), type, sizeof(type))) {
+					// This band doesn't exist.
+					break;
+				}
 			}
-			// Translators: A parameter in the FX Parameters dialog which adjusts
-			// whether a ReaEQ band is enabled. {} will be replaced with the band
-			// number; e.g. "band 2 enable".
-			string dispName = format(translate("Band {} enable"), band + 1);
-			this->namedConfigParams.push_back(FxNamedConfigParam(*this, dispName,
-				name.str(), TOGGLE_FX_NAMED_CONFIG_PARAM_VALUES));
-			name.str("");
-			name << "BANDTYPE" << band;
-			// Translators: A parameter in the FX Parameters dialog which adjusts
-			// the type of a ReaEQ band. {} will be replaced with the band number;
-			// e.g. "band 2 type".
-			dispName = format(translate("Band {} type"), band + 1);
-			this->namedConfigParams.push_back(FxNamedConfigParam(*this, dispName,
-				name.str(), REAEQ_BAND_TYPE_VALUES));
 		}
 	}
+	for (int band = 0; band < bands; ++band) {
+		ostringstream name;
+		name << "BANDENABLED" << band;
+		// Translators: A parameter in the FX Parameters dialog which adjusts
+		// whether a ReaEQ band is enabled. {} will be replaced with the band
+		// number; e.g. "band 2 enable".
+		string dispName = format(translate("Band {} enable"), band + 1);
+		this->namedConfigParams.push_back(FxNamedConfigParam(*this, dispName,
+			name.str(), TOGGLE_FX_NAMED_CONFIG_PARAM_VALUES));
+		name.str("");
+		name << "BANDTYPE" << band;
+		// Translators: A parameter in the FX Parameters dialog which adjusts
+		// the type of a ReaEQ band. {} will be replaced with the band number;
+		// e.g. "band 2 type".
+		dispName = format(translate("Band {} type"), band + 1);
+		this->namedConfigParams.push_back(FxNamedConfigParam(*this, dispName,
+			name.str(), REAEQ_BAND_TYPE_VALUES));
+	}
 }
 
 template<typename ReaperObj>
@@ -1783,158 +2008,31 @@ void cmdParamsFocus(Command* command) {
 	new ParamsDialog(std::move(source));
 }
 
-// Iterates through effects, including effects in containers.
+// Get the name to present for an effect in the menu of effects.
 template<typename ReaperObj>
-class FxIterator {
-	public:
-	FxIterator(ReaperObj obj): obj(obj) {
-		StackItem item;
-		// The first call to next() should move to the first effect, index 0.
-		item.indexInContainer = -1;
-		if constexpr(is_same_v<ReaperObj, MediaTrack*>) {
-			item.containerCount = TrackFX_GetCount(obj);
-		} else {
-			item.containerCount = TakeFX_GetCount(obj);
-		}
-		this->stack.push_back(item);
-	}
-
-	bool next() {
-		StackItem* current = &this->stack.back();
-		if (this->containedCount) {
-			// This is a container. Enter it.
-			StackItem sub;
-			if (this->stack.size() == 1) {
-				// This is a top level container.
-				sub.containerFxIndex = 0x2000000 + current->indexInContainer + 1;
+string getFxMenuName(ReaperObj* obj, const FxTree::Entry& entry) {
+	ostringstream s;
+	s << (entry.indexInContainer + 1) << " ";
+	shortenFxName(entry.name.c_str(), s);
+	if constexpr (is_same_v<ReaperObj, MediaTrack>) {
+		if (entry.isRec && entry.level == 1) {
+			s << " ";
+			if (obj == GetMasterTrack(nullptr)) {
+				// Translators: In the menu of effects when opening the FX Parameters
+				// dialog, this is presented after effects which are monitoring FX.
+				s << translate("[monitor]");
 			} else {
-				sub.containerFxIndex = this->fxIndex;
+				// Translators: In the menu of effects when opening the FX Parameters
+				// dialog, this is presented after effects which are input FX.
+				s << translate("[input]");
 			}
-			sub.multiplier = current->multiplier * (current->containerCount + 1);
-			sub.containerCount = this->containedCount;
-			this->stack.push_back(sub);
-			return this->success();
-		}
-		for (;;) {
-			// Get the next effect.
-			++current->indexInContainer;
-			if (current->indexInContainer < current->containerCount) {
-				return this->success();
-			}
-			// We've reached the end of this container. Walk out of it.
-			this->stack.pop_back();
-			if (this->stack.empty()) {
-				// There are no more effects of this type.
-				break;
-			}
-			current = &this->stack.back();
-		}
-		if constexpr(is_same_v<ReaperObj, MediaTrack*>) {
-			if (!this->rec) {
-				// There might be input or monitoring effects.
-				return this->firstRec();
-			}
-		}
-		// There are no more effects.
-		return false;
-	}
-
-	int getFxIndex() {
-		return this->fxIndex;
-	}
-
-	bool isContainer() {
-		return !!this->containedCount;
-	}
-
-	string getName() {
-		char name[256];
-		if constexpr (is_same_v<ReaperObj, MediaTrack*>) {
-			TrackFX_GetFXName(obj, this->fxIndex, name, sizeof(name));
-		} else {
-			TakeFX_GetFXName(obj, this->fxIndex, name, sizeof(name));
-		}
-		ostringstream s;
-		s << (this->stack.back().indexInContainer + 1) << " ";
-		shortenFxName(name, s);
-		if constexpr (is_same_v<ReaperObj, MediaTrack*>) {
-			if (rec && this->stack.size() == 1) {
-				s << " ";
-				if (obj == GetMasterTrack(nullptr)) {
-					// Translators: In the menu of effects when opening the FX Parameters
-					// dialog, this is presented after effects which are monitoring FX.
-					s << translate("[monitor]");
-				} else {
-					// Translators: In the menu of effects when opening the FX Parameters
-					// dialog, this is presented after effects which are input FX.
-					s << translate("[input]");
-				}
-			}
-		}
-		return s.str();
-	}
-
-	int getLevel() {
-		return this->stack.size();
-	}
-
-	private:
-	// Called when we successfully iterate to the next effect.
-	bool success() {
-		// Cache the index for this effect.
-		this->fxIndex = this->rec ? 0x1000000 : 0;
-		const StackItem& item = this->stack.back();
-		if (this->stack.size() == 1) {
-			// We're not in a container.
-			this->fxIndex += item.indexInContainer;
-		} else {
-			this->fxIndex +=
-				(item.indexInContainer + 1) * item.multiplier + item.containerFxIndex;
-		}
-		// If this is a container, cache how many effects it contains.
-		char res[5] = "0";
-		if constexpr (is_same_v<ReaperObj, MediaTrack*>) {
-			TrackFX_GetNamedConfigParm(obj, this->fxIndex, "container_count", res,
-				sizeof(res));
-		} else {
-			TakeFX_GetNamedConfigParm(obj, this->fxIndex, "container_count", res,
-				sizeof(res));
 		}
-		this->containedCount = atoi(res);
-		return true;
 	}
-
-	// Iterate to the first input or monitoring effect, if any.
-	bool firstRec() {
-		int count = TrackFX_GetRecCount(obj);
-		if (count > 0) {
-			this->rec = true;
-			StackItem item;
-			item.indexInContainer = 0;
-			item.containerCount = count;
-			this->stack.push_back(item);
-			return this->success();
-		}
-		return false;
-	}
-
-	ReaperObj obj;
-	bool rec = false;
-	int fxIndex = -1;
-	int containedCount = 0;
-
-	struct StackItem {
-		int indexInContainer = 0;
-		int containerCount = 0;
-		int containerFxIndex = 0;
-		int multiplier = 1;
-	};
-	vector<StackItem> stack;
-};
+	return s.str();
+}
 
 template<typename ReaperObj>
 void fxParams_begin(ReaperObj* obj, const string& apiPrefix) {
-	FxIterator iter(obj);
 	int fx = -1;
 	// Present a menu of effects.
 	// We might have sub-menus, so we need a stack.
@@ -1943,19 +2041,19 @@ void fxParams_begin(ReaperObj* obj, const string& apiPrefix) {
 	MENUITEMINFO itemInfo;
 	itemInfo.cbSize = sizeof(MENUITEMINFO);
 	int count = 0;
-	while (iter.next()) {
+	for (const FxTree::Entry& entry: FxTree::get(obj).getEntries()) {
 		// If we've exited containers, move to the appropriate ancestor menu.
-		for (int level = menus.size(); level > iter.getLevel(); --level) {
+		for (int level = menus.size(); level > entry.level; --level) {
 			menus.pop_back();
 		}
 		itemInfo.fMask = MIIM_TYPE;
 		itemInfo.fType = MFT_STRING;
 		// Make sure this stays around until the InsertMenuItem call.
-		const string name = iter.getName();
+		const string name = getFxMenuName(obj, entry);
 		itemInfo.dwTypeData = (char*)name.c_str();
 		itemInfo.cch = name.length();
-		fx = iter.getFxIndex();
-		if (iter.isContainer()) {
+		fx = entry.fxIndex;
+		if (entry.isContainer) {
 			// Create a sub-menu for this container.
 			itemInfo.fMask |= MIIM_SUBMENU;
 			HMENU subMenu = CreatePopupMenu();
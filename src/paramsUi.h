@@ -11,3 +11,6 @@ void cmdFxParamsFocus(Command* command);
 void cmdFxParamsMaster(Command* command);
 void cmdParamsFocus(Command* command);
 extern bool isParamsDialogOpen;
+// Discard cached FX parameter info. Called when FX are added, removed or
+// reordered.
+void invalidateFxParamsCache();
@@ -6,6 +6,9 @@
  */
 
 #include <math.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <string>
 #include <sstream>
 #include <iomanip>
@@ -13,7 +16,6 @@
 #include <variant>
 #include <vector>
 #include<map>
-#include<array>
 #include <utility>
 // osara.h includes windows.h, which must be included before other Windows
 // headers.
@@ -25,11 +27,14 @@
 #include <WDL/win32_utf8.h>
 #include <WDL/db2val.h>
 #include <WDL/wdltypes.h>
+#include "config.h"
 #include "fxChain.h"
+#include "perfTrace.h"
 #include "resource.h"
 #include "translation.h"
 
 using namespace std;
+using namespace fmt::literals;
 
 namespace peakWatcher {
 
@@ -52,6 +57,9 @@ class Watcher;
 bool isWatchingAnything();
 void stop();
 bool isPaused{false};
+// Whether Peak Watcher is sampling levels, either via its own timer or via
+// control surface updates.
+bool isRunning = false;
 
 // Peak Watcher can watch various types of levels; e.g. peak dB, momentary LUFS.
 struct LevelType {
@@ -111,7 +119,20 @@ void describeTarget(Target& target, ostringstream& s) {
 	}
 }
 
+// The number of channels which can be configured in the dialog and reported
+// with the original actions. For tracks with more channels, the second
+// channel's notification setting applies to all channels after the first.
 const int NUM_CHANNELS = 2;
+// The most channels we watch on a single track.
+const int MAX_CHANNELS = 64;
+// The sampling interval in ms for each watcher.
+const int DEFAULT_INTERVAL = 30;
+const int MIN_INTERVAL = 10;
+const int MAX_INTERVAL = 1000;
+// Timers and control surface updates can fire a few ms early or late. Allow
+// for this so that a watcher doesn't skip every other update if its interval
+// matches the scheduler's.
+const DWORD INTERVAL_SLACK = 5;
 
 // Peak Watcher can watch one or more values. Each "watcher" consists of a
 // target, level type and other parameters that determine how/when it is
@@ -126,11 +147,46 @@ class Watcher {
 	double notifyLevel = 0;
 	// Hold time in ms; -1 disabled, 0 forever.
 	int hold = 0;
+	int interval = DEFAULT_INTERVAL;
+	DWORD lastSampleTime = 0;
+	// The loudness meter effect used by LUFS/RMS level types. Finding it by name
+	// searches the entire FX chain, so we cache its index. We only search again
+	// if the FX at this index is no longer the same effect.
 	struct {
-		bool notify = true;
-		double peak = NO_LEVEL;
-		DWORD time = 0;
-	} channels[NUM_CHANNELS];
+		MediaTrack* track = nullptr;
+		int fx = -1;
+		int fxCount = 0;
+		GUID guid;
+		// The config param we last turned on, -1 if none.
+		int configParam = -1;
+	} loudnessMeter;
+	bool notify[NUM_CHANNELS] = {true, true};
+	// The number of channels currently being watched. For level types which
+	// don't have separate channels, all channels have the same value.
+	int numChannels = NUM_CHANNELS;
+	// The held level and when it was measured for each channel. These are
+	// separate arrays rather than an array of structs so that all channels can be
+	// processed in a single pass.
+	array<double, MAX_CHANNELS> peaks;
+	array<DWORD, MAX_CHANNELS> peakTimes;
+
+	Watcher() {
+		this->peaks.fill(NO_LEVEL);
+		this->peakTimes.fill(0);
+	}
+
+	bool shouldNotify(int channel) const {
+		return this->notify[min(channel, NUM_CHANNELS - 1)];
+	}
+
+	// Get the number of channels the target currently has.
+	int getTargetChannelCount() {
+		if (MediaTrack** track = get_if<MediaTrack*>(&this->target)) {
+			int count = (int)GetMediaTrackInfo_Value(*track, "I_NCHAN");
+			return max(min(count, MAX_CHANNELS), 1);
+		}
+		return NUM_CHANNELS;
+	}
 
 	bool isDisabled() {
 		return holds_alternative<NoTarget>(target);
@@ -151,9 +207,8 @@ class Watcher {
 	}
 
 	void reset() {
-		for (auto& channel : this->channels) {
-			channel.peak = NO_LEVEL;
-		}
+		this->peaks.fill(NO_LEVEL);
+		this->loudnessMeter.fx = -1;
 		const LevelType& levelType = this->levelTypeInfo();
 		if (!this->isDisabled() && levelType.reset) {
 			levelType.reset(*this);
@@ -172,14 +227,113 @@ class Watcher {
 	}
 };
 
-const int NUM_WATCHERS = 2;
-map<const ReaProject*, array<Watcher, NUM_WATCHERS> > watchers;
+// Every project has at least this many watchers. More can be added by the
+// user.
+const int DEFAULT_NUM_WATCHERS = 2;
+// We reserve this many watchers up front so the table never reallocates. This
+// means a Watcher& (e.g. held by an open dialog) stays valid when a watcher is
+// added.
+const int MAX_WATCHERS = 16;
+using WatcherTable = vector<Watcher>;
+map<const ReaProject*, WatcherTable> watchers;
+
+WatcherTable& getWatchers(const ReaProject* project) {
+	auto it = watchers.find(project);
+	if (it == watchers.end()) {
+		it = watchers.insert({project, WatcherTable()}).first;
+		it->second.reserve(MAX_WATCHERS);
+		it->second.resize(DEFAULT_NUM_WATCHERS);
+	}
+	return it->second;
+}
+
+// Sampling happens very frequently, so we cache the table for the current
+// project rather than looking it up each time.
+const ReaProject* cachedProject = nullptr;
+WatcherTable* cachedWatchers = nullptr;
+
+WatcherTable& currentWatchers() {
+	const ReaProject* project = currentProject();
+	if (!cachedWatchers || project != cachedProject) {
+		cachedProject = project;
+		cachedWatchers = &getWatchers(project);
+	}
+	return *cachedWatchers;
+}
+
+// REAPER has a single peak hold for each track channel. Peak dB watchers and
+// the over detector both read it and clear it so they don't miss peaks between
+// samples, but a clear by one would then lose peaks for the other. To avoid
+// this, all reads go through readPeakHold, which keeps what it cleared for the
+// other reader until that reader next reads the same channel.
+enum PeakReader {
+	PEAK_READER_WATCHER,
+	PEAK_READER_OVER_DETECTOR,
+	PEAK_READER_COUNT
+};
+// The level type index for peak dB.
+const unsigned int LEVEL_TYPE_PEAK = 0;
+// Whether the over detector is in the middle of a pass.
+bool isOverDetectorRunning = false;
+map<pair<MediaTrack*, int>, double> pendingPeaks[PEAK_READER_COUNT];
+
+bool isPeakReaderInterested(PeakReader reader, MediaTrack* track) {
+	if (reader == PEAK_READER_OVER_DETECTOR) {
+		return isOverDetectorRunning;
+	}
+	for (Watcher& watcher : currentWatchers()) {
+		if (watcher.levelType == LEVEL_TYPE_PEAK &&
+				holds_alternative<MediaTrack*>(watcher.target) &&
+				varGet<MediaTrack*>(watcher.target) == track) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Get the peak for a track channel since reader last read it and reset
+// REAPER's hold. If discardHold is true, REAPER's hold is still passed on to
+// the other readers, but only the peaks kept for this reader are returned.
+double readPeakHold(MediaTrack* track, int channel, PeakReader reader,
+	bool discardHold = false
+) {
+	// Undocumented: Track_GetPeakHoldDB returns hundredths of a dB. Passing
+	// clear returns the hold and then resets it, so one call does both.
+	const double hold = Track_GetPeakHoldDB(track, channel, true) * 100.0;
+	double peak = discardHold ? NO_LEVEL : hold;
+	const auto key = make_pair(track, channel);
+	for (int other = 0; other < PEAK_READER_COUNT; ++other) {
+		if (other == reader ||
+				!isPeakReaderInterested((PeakReader)other, track)) {
+			continue;
+		}
+		auto [it, inserted] = pendingPeaks[other].try_emplace(key, hold);
+		if (!inserted) {
+			it->second = max(it->second, hold);
+		}
+	}
+	auto& pending = pendingPeaks[reader];
+	if (auto it = pending.find(key); it != pending.end()) {
+		peak = max(peak, it->second);
+		pending.erase(it);
+	}
+	return peak;
+}
 
-const char* WATCHER_NAMES[NUM_WATCHERS] = {
+const CachedTranslation WATCHER_NAMES[DEFAULT_NUM_WATCHERS] = {
 	_t("1st watcher"),
 	_t("2nd watcher"),
 };
-const char* CHANNEL_NAMES[NUM_CHANNELS] = {
+
+string getWatcherName(int watcherIndex) {
+	if (watcherIndex < DEFAULT_NUM_WATCHERS) {
+		return WATCHER_NAMES[watcherIndex].get();
+	}
+	// Translators: The name of a Peak Watcher watcher beyond the first two. {}
+	// will be replaced with the watcher number; e.g. "watcher 3".
+	return format(translate("watcher {}"), watcherIndex + 1);
+}
+const CachedTranslation CHANNEL_NAMES[NUM_CHANNELS] = {
 	_t("1st chan"),
 	_t("2nd chan"),
 };
@@ -188,11 +342,32 @@ UINT_PTR timer = 0;
 
 const char FX_LOUDNESS_METER[] = "loudness_meter";
 
+// Returns true if the loudness meter cached for this watcher is still at the
+// cached index.
+bool isCachedLoudnessMeterValid(Watcher& watcher, MediaTrack* track) {
+	auto& cache = watcher.loudnessMeter;
+	if (cache.fx == -1 || cache.track != track ||
+			TrackFX_GetCount(track) != cache.fxCount) {
+		return false;
+	}
+	GUID* guid = TrackFX_GetFXGUID(track, cache.fx);
+	return guid && memcmp(guid, &cache.guid, sizeof(GUID)) == 0;
+}
+
 double getLoudnessMeterParam(Watcher& watcher,
 	int configParam, double configValue, int queryParam
 ) {
 	assert(holds_alternative<MediaTrack*>(watcher.target));
 	MediaTrack* track = varGet<MediaTrack*>(watcher.target);
+	auto& cache = watcher.loudnessMeter;
+	if (isCachedLoudnessMeterValid(watcher, track)) {
+		if (cache.configParam != configParam) {
+			TrackFX_SetParam(track, cache.fx, configParam, configValue);
+			cache.configParam = configParam;
+		}
+		return TrackFX_GetParam(track, cache.fx, queryParam, nullptr, nullptr);
+	}
+	cache.fx = -1;
 	int fx = TrackFX_AddByName(track, FX_LOUDNESS_METER, /* recFX */ false,
 		0 /* don't create */);
 	if (fx == -1) {
@@ -215,8 +390,19 @@ double getLoudnessMeterParam(Watcher& watcher,
 	// Ensure the level type we need is turned on. We do this here rather than
 	// when adding the effect because we might have already added the effect for
 	// another value earlier if two different values are being watched on the same
-	// track.
+	// track. After this, we only do it again if the level type changes or we
+	// have to find the effect again.
 	TrackFX_SetParam(track, fx, configParam, configValue);
+	cache.track = track;
+	cache.fx = fx;
+	cache.fxCount = TrackFX_GetCount(track);
+	if (GUID* guid = TrackFX_GetFXGUID(track, fx)) {
+		cache.guid = *guid;
+	} else {
+		// We can't validate the cache without a GUID, so don't cache.
+		cache.fx = -1;
+	}
+	cache.configParam = configParam;
 	return TrackFX_GetParam(track, fx, queryParam, nullptr, nullptr);
 }
 
@@ -247,11 +433,7 @@ const LevelType LEVEL_TYPES[] = {
 			// #119: We use Track_GetPeakHoldDB even when Peak Watcher's hold
 			//  functionality is disabled because we only measure every 30 ms and we
 			// might miss peaks.
-			// Undocumented: Track_GetPeakHoldDB returns hundredths of a dB.
-			double newPeak = Track_GetPeakHoldDB(track, channel, false) * 100.0;
-			// We have the peak now, so reset REAPER's hold.
-			Track_GetPeakHoldDB(track, channel, true);
-			return newPeak;
+			return readPeakHold(track, channel, PEAK_READER_WATCHER);
 		},
 		/* reset */ nullptr,
 	},
@@ -366,7 +548,7 @@ void Watcher::description(ostringstream& s) {
 }
 
 void resetWatcher(int watcherIndex, bool report=false) {
-	Watcher& watcher = watchers[currentProject()][watcherIndex];
+	Watcher& watcher = currentWatchers()[watcherIndex];
 	watcher.reset();
 	if (report) {
 		if (watcher.isDisabled()) {
@@ -382,7 +564,7 @@ void resetWatcher(int watcherIndex, bool report=false) {
 
 bool isWatchingMultipleValues() {
 	int count = 0;
-	for (Watcher& watcher : watchers[currentProject()]) {
+	for (Watcher& watcher : currentWatchers()) {
 		if (!watcher.isDisabled()) {
 			++count;
 		}
@@ -393,16 +575,242 @@ bool isWatchingMultipleValues() {
 	return count > 1;
 }
 
-void CALLBACK tick(HWND hwnd, UINT msg, UINT_PTR event, DWORD time) {
+string getTrackGuidStr(ReaProject* project, MediaTrack* track);
+
+// Watches every track in the project for overs during playback, rather than a
+// single target. This is useful to find out which tracks clipped during a
+// mastering pass. Querying hundreds of tracks every tick would block the UI, so
+// only a batch of tracks is checked on each tick, limited by both a track count
+// and a time budget. REAPER's meter hold is read without clearing it, so peaks
+// between visits to a track aren't missed.
+class OverDetector {
+	public:
+	bool active = false;
+	// Tracks whose peak exceeds this (in dB) are reported.
+	double level = 0;
+
+	struct Entry {
+		string guid;
+		// nullptr if loaded from the project and not yet matched to a track.
+		MediaTrack* track;
+		double peak;
+		// Whether the track has been visited in the current pass. Until then,
+		// REAPER's hold might contain peaks from before the pass.
+		bool visited = false;
+	};
+	// In track order as of the start of the current cycle through the tracks,
+	// with the master track first.
+	vector<Entry> entries;
+
+	void reset() {
+		this->entries.clear();
+		this->cursor = 0;
+		this->syncedTrackCount = -1;
+		pendingPeaks[PEAK_READER_OVER_DETECTOR].clear();
+	}
+
+	void step(ReaProject* project) {
+		const bool playing = GetPlayState() & 5; // Playing or recording
+		if (!playing) {
+			if (this->wasPlaying) {
+				// The pass has finished.
+				this->wasPlaying = false;
+				isOverDetectorRunning = false;
+				this->report();
+			}
+			return;
+		}
+		if (!this->wasPlaying) {
+			// A new pass is starting.
+			this->wasPlaying = true;
+			this->reset();
+		}
+		isOverDetectorRunning = true;
+		const auto deadline = chrono::steady_clock::now() + TIME_BUDGET;
+		for (int n = 0; n < BATCH_SIZE; ++n) {
+			if (this->cursor == 0) {
+				this->sync(project);
+			}
+			if (this->cursor >= this->entries.size()) {
+				this->cursor = 0;
+				break;
+			}
+			Entry& entry = this->entries[this->cursor++];
+			if (entry.track && ValidatePtr((void*)entry.track, "MediaTrack*")) {
+				int numChannels = max(min(
+					(int)GetMediaTrackInfo_Value(entry.track, "I_NCHAN"), MAX_CHANNELS),
+					1);
+				for (int c = 0; c < numChannels; ++c) {
+					// On the first visit, REAPER's hold might include peaks from before
+					// the pass, so it is just cleared. Peaks a watcher read since the
+					// pass started are still counted, since they were kept for us.
+					// Peaks between the start of the pass and the first visit are
+					// missed, but with the batch size and sampling interval, this is only
+					// about a second even for a project with a thousand tracks.
+					entry.peak = max(entry.peak, readPeakHold(entry.track, c,
+						PEAK_READER_OVER_DETECTOR, /* discardHold */ !entry.visited));
+				}
+				entry.visited = true;
+			}
+			if (chrono::steady_clock::now() >= deadline) {
+				break;
+			}
+		}
+	}
+
+	void report() {
+		vector<const Entry*> overs;
+		for (const Entry& entry : this->entries) {
+			if (entry.track && entry.peak > this->level &&
+					ValidatePtr((void*)entry.track, "MediaTrack*")) {
+				overs.push_back(&entry);
+			}
+		}
+		if (overs.empty()) {
+			// Translators: Reported when the Peak Watcher over detector finishes a
+			// pass and no tracks exceeded the level. {} will be replaced with the
+			// level; e.g. "no tracks over 0.0".
+			outputMessage(format(translate("no tracks over {:.1f}"), this->level));
+			return;
+		}
+		// Loudest first.
+		stable_sort(overs.begin(), overs.end(), [](auto a, auto b) {
+			return a->peak > b->peak;
+		});
+		ostringstream s;
+		s << fixed << setprecision(1);
+		for (const Entry* entry : overs) {
+			describeTrack(entry->track, s);
+			s << ": " << entry->peak << "\r\n";
+		}
+		reviewMessage(translate("Over detector"), s.str().c_str());
+	}
+
+	private:
+	static constexpr int BATCH_SIZE = 32;
+	static constexpr chrono::microseconds TIME_BUDGET{1000};
+
+	// Rebuild entries from the current track list, keeping the peaks already
+	// measured for tracks which still exist. This walks every track, so it is
+	// only done when the track count or the project state change count changed
+	// since the last sync. Adding, removing or reordering tracks changes one of
+	// these.
+	void sync(ReaProject* project) {
+		const int trackCount = CountTracks(project);
+		const int stateCount = GetProjectStateChangeCount(project);
+		if (trackCount == this->syncedTrackCount &&
+				stateCount == this->syncedStateCount) {
+			return;
+		}
+		this->syncedTrackCount = trackCount;
+		this->syncedStateCount = stateCount;
+		vector<Entry> old = std::move(this->entries);
+		sort(old.begin(), old.end(), [](const Entry& a, const Entry& b) {
+			return a.guid < b.guid;
+		});
+		this->entries.clear();
+		this->entries.reserve(trackCount + 1);
+		for (int t = -1; t < trackCount; ++t) {
+			MediaTrack* track = t == -1 ? GetMasterTrack(project) :
+				GetTrack(project, t);
+			string guid = getTrackGuidStr(project, track);
+			double peak = NO_LEVEL;
+			bool visited = false;
+			auto it = lower_bound(old.begin(), old.end(), guid,
+				[](const Entry& entry, const string& guid) {
+					return entry.guid < guid;
+				});
+			if (it != old.end() && it->guid == guid) {
+				peak = it->peak;
+				visited = it->visited;
+			}
+			this->entries.push_back({std::move(guid), track, peak, visited});
+		}
+	}
+
+	size_t cursor = 0;
+	bool wasPlaying = false;
+	// -1 if entries haven't been synced since the last reset.
+	int syncedTrackCount = -1;
+	int syncedStateCount = 0;
+};
+
+map<const ReaProject*, OverDetector> overDetectors;
+
+OverDetector& getOverDetector(const ReaProject* project) {
+	return overDetectors[project];
+}
+
+// Describe the channels which passed the notification level on a track with
+// many channels; e.g. "ch 7 and 8 over -1.0, highest 0.3". Listing each channel
+// with its level would take far too long to speak for a 7.1.4 or ambisonic
+// mix.
+void reportChannelSummary(ostringstream& s, Watcher& watcher,
+	const double* levels, const bool* notifying, int numChannels,
+	int numNotifying
+) {
+	ostringstream channels;
+	double highest = NO_LEVEL;
+	bool hasHighest = false;
+	int listed = 0;
+	for (int c = 0; c < numChannels; ++c) {
+		if (!notifying[c]) {
+			continue;
+		}
+		if (!hasHighest ||
+				watcher.levelTypeInfo().isLevelSignificant(levels[c], highest)) {
+			highest = levels[c];
+			hasHighest = true;
+		}
+		++listed;
+		if (listed > 1) {
+			channels << (listed == numNotifying ?
+				// Translators: Used between the last two channels in a list of Peak
+				// Watcher channels; e.g. the " and " in "ch 1, 2 and 3".
+				translate(" and ") : ", ");
+		}
+		channels << c + 1;
+	}
+	if (numNotifying == 1) {
+		// Translators: Reported by Peak Watcher when a single channel on a track
+		// with many channels passes the notification level. {channel} will be
+		// replaced with the channel number and {level} with its level; e.g.
+		// "ch 7 0.3".
+		s << format(translate("ch {channel} {level:.1f}"),
+			"channel"_a=channels.str(), "level"_a=highest);
+		return;
+	}
+	// Translators: Reported by Peak Watcher when several channels on a track
+	// with many channels pass the notification level. {channels} will be
+	// replaced with the channel numbers, {notify} with the notification level
+	// and {level} with the highest level; e.g. "ch 7 and 8 over -1.0, highest
+	// 0.3".
+	s << format(translate("ch {channels} over {notify:.1f}, highest {level:.1f}"),
+		"channels"_a=channels.str(), "notify"_a=watcher.notifyLevel,
+		"level"_a=highest);
+}
+
+void sample(DWORD time) {
+	OverDetector& detector = getOverDetector(currentProject());
+	if (detector.active) {
+		detector.step(currentProject());
+	} else {
+		isOverDetectorRunning = false;
+	}
 	ostringstream s;
 	s << fixed << setprecision(1);
 	const bool multiple = isWatchingMultipleValues();
-	auto& projWatchers = watchers[currentProject()];
-	for (int w = 0; w < NUM_WATCHERS; ++w) {
+	auto& projWatchers = currentWatchers();
+	for (int w = 0; w < (int)projWatchers.size(); ++w) {
 		Watcher& watcher = projWatchers[w];
 		if (watcher.isDisabled()) {
 			continue;
 		}
+		if (time - watcher.lastSampleTime + INTERVAL_SLACK <
+				(DWORD)watcher.interval) {
+			continue; // Not due yet.
+		}
+		watcher.lastSampleTime = time;
 		const LevelType& levelType = watcher.levelTypeInfo();
 		if (watcher.follow) {
 			Target latest = watcher.getLatestFollowTarget();
@@ -425,67 +833,152 @@ void CALLBACK tick(HWND hwnd, UINT msg, UINT_PTR event, DWORD time) {
 
 		// If this level type doesn't care about separate channels, we only need
 		// to process one channel.
+		if (levelType.separateChannels) {
+			watcher.numChannels = watcher.getTargetChannelCount();
+		}
 		const int numChannels = levelType.separateChannels ?
-			NUM_CHANNELS : 1;
-		bool watcherReported = false;
+			watcher.numChannels : 1;
+		// Fetch all levels first. After that, the held levels and notifications
+		// for all channels are calculated in one pass over the arrays.
+		double levels[MAX_CHANNELS];
 		for (int c = 0; c < numChannels; ++c) {
-			auto& chan = watcher.channels[c];
-			double newPeak = levelType.getLevel(watcher, c) ;
-			if (watcher.hold == -1 // Hold disabled
-				|| levelType.isLevelSignificant(newPeak, chan.peak)
-				|| (watcher.hold != 0 && time > chan.time + watcher.hold)
-			) {
-				chan.peak = newPeak;
-				chan.time = time;
-				if (chan.notify &&
-						newPeak != NO_LEVEL &&
-						levelType.isLevelSignificant(newPeak, watcher.notifyLevel)) {
-					if (s.tellp() > 0) {
-						s << ", ";
-					}
-					if (!watcherReported && multiple) {
-						// Only report which watcher if watching more than one target.
-						s << translate(WATCHER_NAMES[w]) << " ";
-						watcherReported = true;
-					}
-					if (levelType.separateChannels) {
-						s << translate(CHANNEL_NAMES[c]) << " ";
-					}
-					s << newPeak;
-					outputMessage(s);
-				}
+			levels[c] = levelType.getLevel(watcher, c);
+		}
+		const bool holdDisabled = watcher.hold == -1;
+		const bool holdExpires = watcher.hold > 0;
+		bool notifying[MAX_CHANNELS];
+		int numNotifying = 0;
+		// The comparison is chosen once per watcher rather than per channel so
+		// that the pass below is simple enough for the compiler to vectorise.
+		auto pass = [&](auto isSignificant) {
+			for (int c = 0; c < numChannels; ++c) {
+				const double level = levels[c];
+				const bool update = holdDisabled ||
+					isSignificant(level, watcher.peaks[c]) ||
+					(holdExpires && time > watcher.peakTimes[c] + watcher.hold);
+				watcher.peaks[c] = update ? level : watcher.peaks[c];
+				watcher.peakTimes[c] = update ? time : watcher.peakTimes[c];
+				notifying[c] = update && watcher.shouldNotify(c) &&
+					level != NO_LEVEL && isSignificant(level, watcher.notifyLevel);
+				numNotifying += notifying[c];
 			}
+		};
+		if (levelType.isSmallerSignificant) {
+			pass([](double a, double b) {
+				return a < b || (b == NO_LEVEL && a != NO_LEVEL);
+			});
+		} else {
+			pass([](double a, double b) { return a > b; });
 		}
 		if (!levelType.separateChannels) {
 			// Copy the value to the other channels for on-demand reporting.
-			for (int c = 1; c < NUM_CHANNELS; ++c) {
-				watcher.channels[c].peak = watcher.channels[0].peak;
+			fill(watcher.peaks.begin() + 1,
+				watcher.peaks.begin() + watcher.numChannels, watcher.peaks[0]);
+		}
+		if (numNotifying == 0) {
+			continue;
+		}
+		if (s.tellp() > 0) {
+			s << ", ";
+		}
+		if (multiple) {
+			// Only report which watcher if watching more than one target.
+			s << getWatcherName(w) << " ";
+		}
+		if (!levelType.separateChannels) {
+			s << levels[0];
+		} else if (numChannels <= NUM_CHANNELS) {
+			bool first = true;
+			for (int c = 0; c < numChannels; ++c) {
+				if (!notifying[c]) {
+					continue;
+				}
+				if (!first) {
+					s << ", ";
+				}
+				first = false;
+				s << CHANNEL_NAMES[c].get() << " " << levels[c];
 			}
+		} else {
+			reportChannelSummary(s, watcher, levels, notifying, numChannels,
+				numNotifying);
 		}
+		// Several watchers might report at once, so let the newest (most complete)
+		// message replace a pending one.
+		queueMessage(OUTPUT_PEAK_WATCHER, s.str());
 	}
 }
 
-void start() {
-	if (timer) {
-		return;
-	}
-	timer = SetTimer(nullptr, 0, 30, tick);
+void CALLBACK tick(HWND hwnd, UINT msg, UINT_PTR event, DWORD time) {
+	perfTrace::ScopedTimer timer(perfTrace::SITE_PEAK_WATCHER_TICK);
+	sample(time);
 }
 
-void stop() {
+void stopTimer() {
 	if (timer){
 		KillTimer(nullptr, timer);
 		timer = 0;
 	}
 }
 
+void startTimer() {
+	stopTimer();
+	// The timer needs to fire often enough for the watcher with the shortest
+	// interval.
+	int interval = MAX_INTERVAL;
+	for (Watcher& watcher : currentWatchers()) {
+		if (!watcher.isDisabled()) {
+			interval = min(interval, watcher.interval);
+		}
+	}
+	if (getOverDetector(currentProject()).active) {
+		interval = min(interval, DEFAULT_INTERVAL);
+	}
+	timer = SetTimer(nullptr, 0, interval, tick);
+}
+
+// Start sampling or, if already running, apply any changes to watcher
+// intervals or the scheduling mode.
+void start() {
+	isRunning = true;
+	if (settings::peakWatcherFromControlSurface) {
+		// onControlSurfaceRun will do the sampling.
+		stopTimer();
+	} else {
+		startTimer();
+	}
+}
+
+void stop() {
+	isRunning = false;
+	stopTimer();
+}
+
+void onControlSurfaceRun() {
+	if (!isRunning) {
+		return;
+	}
+	// The scheduling mode can be changed at any time, so switch between the
+	// timer and control surface updates as needed.
+	if (!settings::peakWatcherFromControlSurface) {
+		if (!timer) {
+			startTimer();
+		}
+		return;
+	}
+	if (timer) {
+		stopTimer();
+	}
+	sample(GetTickCount());
+}
+
 bool isWatchingAnything() {
-	for (Watcher& watcher : watchers[currentProject()]) {
+	for (Watcher& watcher : currentWatchers()) {
 		if (!watcher.isDisabled()) {
 			return true;
 		}
 	}
-	return false;
+	return getOverDetector(currentProject()).active;
 }
 
 Target getFocusedTarget() {
@@ -549,7 +1042,7 @@ class Dialog {
 
 		// Retrieve the notification state for channels.
 		for (int c = 0; c < NUM_CHANNELS; ++c) {
-			this->watcher.channels[c].notify =
+			this->watcher.notify[c] =
 				IsDlgButtonChecked(this->dialog, ID_PEAK_CHAN1 + c) == BST_CHECKED;
 		}
 
@@ -575,9 +1068,18 @@ class Dialog {
 			this->watcher.hold = max(min(this->watcher.hold, 20000), 1);
 		}
 
-		if (!timer) { // Previously disabled or paused.
-			start();
+		// Retrieve the sampling interval.
+		if (GetDlgItemText(this->dialog, ID_PEAK_INTERVAL, inText,
+				sizeof(inText)) > 0) {
+			this->watcher.interval = atoi(inText);
+			// Restrict the range.
+			this->watcher.interval = max(min(this->watcher.interval, MAX_INTERVAL),
+				MIN_INTERVAL);
 		}
+
+		// This starts Peak Watcher if it was previously disabled or paused. If it
+		// is already running, this applies any interval change.
+		start();
 	}
 
 	static INT_PTR CALLBACK dialogProc(HWND dialogHwnd, UINT msg,
@@ -667,7 +1169,7 @@ class Dialog {
 		ComboBox_SetCurSel(typeCombo, typeSel);
 
 		for (int c = 0; c < NUM_CHANNELS; ++c) {
-			CheckDlgButton(this->dialog, ID_PEAK_CHAN1 + c, watcher.channels[c].notify
+			CheckDlgButton(this->dialog, ID_PEAK_CHAN1 + c, watcher.notify[c]
 				? BST_CHECKED : BST_UNCHECKED);
 		}
 
@@ -696,30 +1198,77 @@ class Dialog {
 		}
 		CheckDlgButton(this->dialog, id, BST_CHECKED);
 		EnableWindow(holdTime, watcher.hold > 0);
+		s.str("");
+
+		HWND interval = GetDlgItem(this->dialog, ID_PEAK_INTERVAL);
+#ifdef _WIN32
+		SendMessage(interval, EM_SETLIMITTEXT, 4, 0);
+#endif
+		s << watcher.interval;
+		SetWindowText(interval, s.str().c_str());
 
 		ShowWindow(this->dialog, SW_SHOWNORMAL);
 	}
 };
 
-void report(int watcherIndex, int channel) {
-	assert(watcherIndex < NUM_WATCHERS);
-	assert(channel < NUM_CHANNELS);
-	Watcher& watcher = watchers[currentProject()][watcherIndex];
+// Returns nullptr and reports why if the watcher can't be reported.
+Watcher* getReportableWatcher(int watcherIndex) {
+	auto& projWatchers = currentWatchers();
+	assert(watcherIndex < (int)projWatchers.size());
+	Watcher& watcher = projWatchers[watcherIndex];
 	if (watcher.isDisabled()) {
 		// Translators: Reported when the user tries to report a Peak Watcher
 		// channel, but the Peak Watcher value is disabled.
 		outputMessage(translate("watcher disabled"));
-		return;
+		return nullptr;
 	}
-	if (!timer) {
+	if (!isRunning) {
 		// Translators: Reported when the user tries to report a Peak Watcher
 		// channel, but the Peak Watcher is paused.
 		outputMessage(translate("Peak Watcher paused"));
+		return nullptr;
+	}
+	return &watcher;
+}
+
+void report(int watcherIndex, int channel) {
+	assert(channel < MAX_CHANNELS);
+	Watcher* watcher = getReportableWatcher(watcherIndex);
+	if (!watcher) {
 		return;
 	}
 	ostringstream s;
 	s << fixed << setprecision(1);
-	s << watcher.channels[channel].peak;
+	s << watcher->peaks[channel];
+	outputMessage(s);
+}
+
+void reportAllChannels(int watcherIndex) {
+	Watcher* watcher = getReportableWatcher(watcherIndex);
+	if (!watcher) {
+		return;
+	}
+	ostringstream s;
+	s << fixed << setprecision(1);
+	if (!watcher->levelTypeInfo().separateChannels) {
+		s << watcher->peaks[0];
+		outputMessage(s);
+		return;
+	}
+	for (int c = 0; c < watcher->numChannels; ++c) {
+		if (c > 0) {
+			s << ", ";
+		}
+		if (watcher->numChannels <= NUM_CHANNELS) {
+			s << CHANNEL_NAMES[c].get() << " ";
+		} else {
+			// Translators: Used when reporting all channels of a Peak Watcher
+			// watcher with many channels. {} will be replaced with the channel
+			// number; e.g. "ch 7".
+			s << format(translate("ch {}"), c + 1) << " ";
+		}
+		s << watcher->peaks[c];
+	}
 	outputMessage(s);
 }
 
@@ -760,9 +1309,14 @@ string getTrackGuidStr(ReaProject* project, MediaTrack* track) {
 /*
  * Example config block:
 <OSARA_PEAKWATCHER
-  WATCHER TRACK {someGuid} TYPE 0 FOLLOW 1 LEVEL 0.0 HOLD 0 NOTIFY 0 0
-  WATCHER TRACKFX {someGuid} 5 TYPE 0 FOLLOW 0 LEVEL -5.0 HOLD -1 NOTIFY 1 1
+  WATCHER TRACK {someGuid} TYPE 0 FOLLOW 1 LEVEL 0.0 HOLD 0 NOTIFY 0 0 INTERVAL 30
+  WATCHER TRACKFX {someGuid} 5 TYPE 0 FOLLOW 0 LEVEL -5.0 HOLD -1 NOTIFY 1 1 INTERVAL 100
+  OVERDETECTOR ACTIVE 1 LEVEL 0.0
+  OVER MASTER 1.5
+  OVER {someGuid} 0.2
 >
+The over detector lines come after all watchers so that older versions, which
+count every line as a watcher, still load the watchers correctly.
  */
 
 const char CONFIG_HEADER[] = "<OSARA_PEAKWATCHER";
@@ -776,22 +1330,46 @@ bool processExtensionLine(const char* line, ProjectStateContext* ctx,
 	}
 	stop();
 	ReaProject* project = GetCurrentProjectInLoadSave();
-	auto& projWatchers = watchers[project];
+	auto& projWatchers = getWatchers(project);
+	OverDetector& detector = getOverDetector(project);
+	detector = OverDetector();
 	for (int w = 0; ; ++w) {
 		char data[500];
 		ctx->GetLine(data, sizeof(data));
 		if (strcmp(data, CONFIG_FOOTER) == 0) {
 			break;
 		}
-		if (w >= NUM_WATCHERS) {
-			continue;
-		}
 		istringstream input(data);
 		string word;
 		input >> word;
+		if (word == "OVERDETECTOR") {
+			input >> word;
+			if (word == "ACTIVE") {
+				input >> word;
+				detector.active = word == "1";
+			}
+			input >> word;
+			if (word == "LEVEL") {
+				input >> detector.level;
+			}
+			continue;
+		}
+		if (word == "OVER") {
+			OverDetector::Entry entry{"", nullptr, NO_LEVEL};
+			input >> entry.guid >> entry.peak;
+			entry.track = getTrackFromGuidStr(project, entry.guid);
+			detector.entries.push_back(std::move(entry));
+			continue;
+		}
+		if (w >= MAX_WATCHERS) {
+			continue;
+		}
 		if (word != "WATCHER") {
 			continue;
 		}
+		if (w >= (int)projWatchers.size()) {
+			projWatchers.resize(w + 1);
+		}
 		Watcher& watcher = projWatchers[w];
 		watcher.reset();
 		input >> word;
@@ -827,11 +1405,17 @@ bool processExtensionLine(const char* line, ProjectStateContext* ctx,
 		}
 		input >> word;
 		if (word == "NOTIFY") {
-			for (auto& channel : watcher.channels) {
+			for (bool& notify : watcher.notify) {
 				input >> word;
-				channel.notify = word == "1";
+				notify = word == "1";
 			}
 		}
+		input >> word;
+		if (word == "INTERVAL") {
+			input >> watcher.interval;
+			watcher.interval = max(min(watcher.interval, MAX_INTERVAL),
+				MIN_INTERVAL);
+		}
 	}
 	if (project == currentProject() && isWatchingAnything()) {
 		start();
@@ -847,7 +1431,7 @@ void saveExtensionConfig(ProjectStateContext* ctx, bool isUndo,
 	}
 	ctx->AddLine(CONFIG_HEADER);
 	ReaProject* project = GetCurrentProjectInLoadSave();
-	for (Watcher& watcher : watchers[project]) {
+	for (Watcher& watcher : getWatchers(project)) {
 		ostringstream out;
 		out << "WATCHER";
 		if (holds_alternative<NoTarget>(watcher.target)) {
@@ -863,11 +1447,27 @@ void saveExtensionConfig(ProjectStateContext* ctx, bool isUndo,
 		out << " LEVEL " << watcher.notifyLevel;
 		out << " HOLD " << watcher.hold;
 		out << " NOTIFY";
-		for (auto& channel : watcher.channels) {
-			out << " " << (int)channel.notify;
+		for (bool notify : watcher.notify) {
+			out << " " << (int)notify;
 		}
+		out << " INTERVAL " << watcher.interval;
 		ctx->AddLine("%s", out.str().c_str());
 	}
+	OverDetector& detector = getOverDetector(project);
+	if (detector.active || !detector.entries.empty()) {
+		ostringstream out;
+		out << "OVERDETECTOR ACTIVE " << (int)detector.active << " LEVEL " <<
+			detector.level;
+		ctx->AddLine("%s", out.str().c_str());
+		for (const OverDetector::Entry& entry : detector.entries) {
+			if (entry.peak == NO_LEVEL) {
+				continue;
+			}
+			out.str("");
+			out << "OVER " << entry.guid << " " << entry.peak;
+			ctx->AddLine("%s", out.str().c_str());
+		}
+	}
 	ctx->AddLine(CONFIG_FOOTER);
 }
 
@@ -877,6 +1477,11 @@ void BeginLoadProjectState (bool isUndo, struct project_config_extension_t* reg)
 auto const& project = item.first;
 return ! ValidatePtr((void*)project, "ReaProject*");
 	});
+	erase_if(overDetectors, [](const auto& item) {
+		return !ValidatePtr((void*)item.first, "ReaProject*");
+	});
+	// The cached table might have been erased.
+	cachedWatchers = nullptr;
 }
 
 void initialize() {
@@ -917,16 +1522,16 @@ void cmdPeakWatcher(Command* command) {
 	// MIIM_TYPE is deprecated, but win32_utf8 still relies on it.
 	itemInfo.fMask = MIIM_TYPE | MIIM_ID;
 	itemInfo.fType = MFT_STRING;
-	const ReaProject* project = peakWatcher::currentProject();
-	auto& projWatchers = peakWatcher::watchers[project];
-	for (int w = 0; w < peakWatcher::NUM_WATCHERS; ++w) {
+	auto& projWatchers = peakWatcher::currentWatchers();
+	const int numWatchers = (int)projWatchers.size();
+	for (int w = 0; w < numWatchers; ++w) {
 		itemInfo.wID = w + 1;
 		ostringstream s;
 		// Translators: Used when asking which Peak Watcher value to configure.
 		// {} will be replaced with the value number; e.g. "Value &2".
 		// After this, information about the existing configuration for the value
 		// will be appended.
-		s << translate(peakWatcher::WATCHER_NAMES[w]) << ", ";
+		s << peakWatcher::getWatcherName(w) << ", ";
 		projWatchers[w].description(s);
 		// Make sure this stays around until the InsertMenuItem call.
 		string str = s.str();
@@ -934,12 +1539,25 @@ void cmdPeakWatcher(Command* command) {
 		itemInfo.cch = (int)s.tellp();
 		InsertMenuItem(menu, w, true, &itemInfo);
 	}
+	if (numWatchers < peakWatcher::MAX_WATCHERS) {
+		itemInfo.wID = numWatchers + 1;
+		// Translators: An item in the Peak Watcher menu which adds another watcher.
+		const char* label = translate("&Add watcher");
+		itemInfo.dwTypeData = (char*)label;
+		itemInfo.cch = (int)strlen(label);
+		InsertMenuItem(menu, numWatchers, true, &itemInfo);
+	}
 	int w = TrackPopupMenu(menu, TPM_NONOTIFY | TPM_RETURNCMD, 0, 0, 0,
 		mainHwnd, nullptr) - 1;
 	DestroyMenu(menu);
 	if (w == -1) {
 		return;
 	}
+	if (w == numWatchers) {
+		// Capacity was reserved up front, so this doesn't invalidate references
+		// to existing watchers.
+		projWatchers.emplace_back();
+	}
 	peakWatcher::Watcher& watcher = projWatchers[w];
 
 	new peakWatcher::Dialog(target, watcher, types);
@@ -961,6 +1579,14 @@ void cmdReportPeakWatcherW2C2(Command* command) {
 	peakWatcher::report(1, 1);
 }
 
+void cmdReportPeakWatcherW1All(Command* command) {
+	peakWatcher::reportAllChannels(0);
+}
+
+void cmdReportPeakWatcherW2All(Command* command) {
+	peakWatcher::reportAllChannels(1);
+}
+
 void cmdResetPeakWatcherW1(Command* command) {
 	peakWatcher::resetWatcher(0, true);
 }
@@ -969,8 +1595,40 @@ void cmdResetPeakWatcherW2(Command* command) {
 	peakWatcher::resetWatcher(1, true);
 }
 
+void cmdToggleOverDetector(Command* command) {
+	auto& detector = peakWatcher::getOverDetector(peakWatcher::currentProject());
+	detector.active = !detector.active;
+	if (detector.active) {
+		if (!peakWatcher::isPaused) {
+			peakWatcher::start();
+		}
+		// Translators: Reported when the Peak Watcher over detector is enabled.
+		outputMessage(translate("over detector enabled, reports when playback stops"));
+	} else {
+		if (!peakWatcher::isWatchingAnything()) {
+			peakWatcher::stop();
+		} else if (!peakWatcher::isPaused) {
+			// Apply the interval of the remaining watchers.
+			peakWatcher::start();
+		}
+		// Translators: Reported when the Peak Watcher over detector is disabled.
+		outputMessage(translate("over detector disabled"));
+	}
+}
+
+void cmdReportOverDetector(Command* command) {
+	auto& detector = peakWatcher::getOverDetector(peakWatcher::currentProject());
+	if (detector.entries.empty()) {
+		// Translators: Reported when the user asks for the results of the Peak
+		// Watcher over detector, but it hasn't measured anything yet.
+		outputMessage(translate("over detector has no results"));
+		return;
+	}
+	detector.report();
+}
+
 void cmdPausePeakWatcher(Command* command) {
-	if (peakWatcher::timer) {
+	if (peakWatcher::isRunning) {
 		// Running.
 		peakWatcher::stop();
 		peakWatcher::isPaused=true;
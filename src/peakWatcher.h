@@ -10,6 +10,9 @@
 namespace peakWatcher {
 void initialize();
 void onSwitchTab();
+// Called from the control surface's Run() method so Peak Watcher can sample
+// levels there instead of using its own timer.
+void onControlSurfaceRun();
 }
 
 void cmdPeakWatcher(Command* command);
@@ -17,7 +20,11 @@ void cmdReportPeakWatcherW1C1(Command* command);
 void cmdReportPeakWatcherW1C2(Command* command);
 void cmdReportPeakWatcherW2C1(Command* command);
 void cmdReportPeakWatcherW2C2(Command* command);
+void cmdReportPeakWatcherW1All(Command* command);
+void cmdReportPeakWatcherW2All(Command* command);
 void cmdResetPeakWatcherW1(Command* command);
 void cmdResetPeakWatcherW2(Command* command);
 void cmdPausePeakWatcher(Command* command);
+void cmdToggleOverDetector(Command* command);
+void cmdReportOverDetector(Command* command);
 
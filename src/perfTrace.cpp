@@ -0,0 +1,212 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Performance trace code
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "perfTrace.h"
+#include "translation.h"
+
+using namespace std;
+using namespace fmt::literals;
+
+namespace perfTrace {
+
+struct Sample {
+	// Microseconds since OSARA was loaded.
+	int64_t startUs;
+	uint32_t durationUs;
+	int section;
+	int detail;
+	Site site;
+};
+
+// A power of 2 so that the write index can simply be masked.
+constexpr size_t CAPACITY = 1 << 14;
+Sample samples[CAPACITY];
+// The total number of samples ever recorded. Writers claim a slot by
+// incrementing this, so recording never takes a lock. Almost all of the timed
+// code runs on the main thread anyway.
+atomic<uint64_t> sampleCount{0};
+const Clock::time_point traceStart = Clock::now();
+
+void record(Site site, Clock::time_point start, int section, int detail) {
+	auto end = Clock::now();
+	uint64_t index = sampleCount.fetch_add(1, memory_order_relaxed);
+	Sample& sample = samples[index & (CAPACITY - 1)];
+	sample.startUs = chrono::duration_cast<chrono::microseconds>(
+		start - traceStart).count();
+	sample.durationUs = (uint32_t)chrono::duration_cast<chrono::microseconds>(
+		end - start).count();
+	sample.section = section;
+	sample.detail = detail;
+	sample.site = site;
+}
+
+// Copy the samples which haven't been overwritten, oldest first.
+vector<Sample> getSamples() {
+	uint64_t count = sampleCount.load(memory_order_acquire);
+	uint64_t first = count > CAPACITY ? count - CAPACITY : 0;
+	vector<Sample> result;
+	result.reserve((size_t)(count - first));
+	for (uint64_t i = first; i < count; ++i) {
+		result.push_back(samples[i & (CAPACITY - 1)]);
+	}
+	return result;
+}
+
+bool isCommandSite(Site site) {
+	return site == SITE_COMMAND || site == SITE_POST_COMMAND;
+}
+
+string getSiteName(Site site) {
+	switch (site) {
+		case SITE_COMMAND:
+			// Translators: The name of a code path timed by the performance trace.
+			return translate("command");
+		case SITE_POST_COMMAND:
+			// Translators: The name of a code path timed by the performance trace.
+			return translate("command feedback");
+		case SITE_OUTPUT_MESSAGE:
+			// Translators: The name of a code path timed by the performance trace.
+			return translate("message output");
+		case SITE_SURFACE_RUN:
+			// Translators: The name of a code path timed by the performance trace.
+			return translate("control surface update");
+		case SITE_PEAK_WATCHER_TICK:
+			// Translators: The name of a code path timed by the performance trace.
+			return translate("Peak Watcher update");
+		case SITE_WIN_EVENT:
+			// Translators: The name of a code path timed by the performance trace.
+			return translate("window event");
+		case SITE_KEYBOARD_HOOK:
+			// Translators: The name of a code path timed by the performance trace.
+			return translate("keyboard hook");
+		default:
+			return "";
+	}
+}
+
+string getSampleName(const Sample& sample) {
+	if (!isCommandSite(sample.site)) {
+		return getSiteName(sample.site);
+	}
+	const char* action = getActionName(sample.detail,
+		SectionFromUniqueID(sample.section), false);
+	if (sample.site == SITE_COMMAND) {
+		return action;
+	}
+	return format("{} ({})", action, getSiteName(sample.site));
+}
+
+} // namespace perfTrace
+
+using namespace perfTrace;
+
+void cmdReportPerfTrace(Command* command) {
+	vector<Sample> all = getSamples();
+	if (all.empty()) {
+		outputMessage(translate("no performance samples recorded"));
+		return;
+	}
+	// Group samples by site and, for commands, by command. Other sites have
+	// many different details (e.g. every key), which wouldn't be useful to
+	// report separately.
+	map<tuple<int, int, int>, vector<uint32_t>> groups;
+	map<tuple<int, int, int>, const Sample*> firstSamples;
+	for (const Sample& sample : all) {
+		tuple<int, int, int> key = isCommandSite(sample.site) ?
+			make_tuple((int)sample.site, sample.section, sample.detail) :
+			make_tuple((int)sample.site, 0, 0);
+		groups[key].push_back(sample.durationUs);
+		firstSamples.emplace(key, &sample);
+	}
+	struct Summary {
+		string name;
+		size_t count;
+		double p50;
+		double p99;
+		double max;
+	};
+	vector<Summary> summaries;
+	summaries.reserve(groups.size());
+	for (auto& [key, durations] : groups) {
+		sort(durations.begin(), durations.end());
+		auto percentile = [&durations](size_t percent) {
+			size_t index = (durations.size() * percent + 99) / 100;
+			return durations[max<size_t>(index, 1) - 1] / 1000.0;
+		};
+		summaries.push_back({getSampleName(*firstSamples[key]), durations.size(),
+			percentile(50), percentile(99), durations.back() / 1000.0});
+	}
+	// Slowest first.
+	sort(summaries.begin(), summaries.end(), [](auto& a, auto& b) {
+		return a.p99 > b.p99;
+	});
+	ostringstream s;
+	for (const Summary& summary : summaries) {
+		s << summary.name << ": " <<
+			// Translators: Used when reporting the performance trace. {count} will be
+			// replaced with the number of samples, {p50} with the median time, {p99}
+			// with the time within which 99% of samples completed and {max} with the
+			// slowest time; e.g. "12 samples, median 0.21 ms, 99% within 4.02 ms, max
+			// 7.30 ms".
+			format(translate(
+				"{count} samples, median {p50:.2f} ms, 99% within {p99:.2f} ms, max {max:.2f} ms"),
+				"count"_a=summary.count, "p50"_a=summary.p50, "p99"_a=summary.p99,
+				"max"_a=summary.max) << "\r\n";
+	}
+	reviewMessage(translate("Performance trace"), s.str().c_str());
+}
+
+void cmdExportPerfTrace(Command* command) {
+	vector<Sample> all = getSamples();
+	if (all.empty()) {
+		outputMessage(translate("no performance samples recorded"));
+		return;
+	}
+	string path(GetResourcePath());
+	path += "/osara_perftrace.csv";
+#ifdef _WIN32
+	// REAPER provides UTF-8 strings, but a narrow path would be interpreted as
+	// ANSI on Windows.
+	ofstream output(widen(path));
+#else
+	ofstream output(path);
+#endif
+	if (!output) {
+		outputMessage(translate("couldn't write performance trace"));
+		return;
+	}
+	output << "site,section,detail,name,start_us,duration_us\n";
+	for (const Sample& sample : all) {
+		string name = getSampleName(sample);
+		// Escape quotes for CSV.
+		string quoted;
+		for (char c : name) {
+			if (c == '"') {
+				quoted += '"';
+			}
+			quoted += c;
+		}
+		output << (int)sample.site << "," << sample.section << "," <<
+			sample.detail << ",\"" << quoted << "\"," << sample.startUs << "," <<
+			sample.durationUs << "\n";
+	}
+	output.close();
+	// Translators: Reported after exporting the performance trace. {count} will
+	// be replaced with the number of samples and {path} with the file they were
+	// written to.
+	outputMessage(format(translate("exported {count} samples to {path}"),
+		"count"_a=all.size(), "path"_a=path));
+}
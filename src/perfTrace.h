@@ -0,0 +1,69 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Performance trace header
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include "osara.h"
+#include "config.h"
+
+// Records how long OSARA spends in its hot paths so that performance problems
+// can be diagnosed on users' machines. This is only active when the
+// perfTrace setting is enabled. Otherwise, a timer costs a single check of a
+// bool.
+namespace perfTrace {
+
+// The code paths which are timed.
+enum Site : uint8_t {
+	SITE_COMMAND,
+	SITE_POST_COMMAND,
+	SITE_OUTPUT_MESSAGE,
+	SITE_SURFACE_RUN,
+	SITE_PEAK_WATCHER_TICK,
+	SITE_WIN_EVENT,
+	SITE_KEYBOARD_HOOK,
+	SITE_COUNT
+};
+
+using Clock = std::chrono::steady_clock;
+
+void record(Site site, Clock::time_point start, int section, int detail);
+
+// Times the enclosing scope. For command sites, section and detail are the
+// section and command id. For other sites, detail is site specific; e.g. the
+// event for a WinEvent or the key for the keyboard hook.
+class ScopedTimer {
+	public:
+	ScopedTimer(Site site, int section = 0, int detail = 0):
+		site(site), section(section), detail(detail), active(settings::perfTrace) {
+		if (this->active) {
+			this->start = Clock::now();
+		}
+	}
+
+	~ScopedTimer() {
+		if (this->active) {
+			record(this->site, this->start, this->section, this->detail);
+		}
+	}
+
+	ScopedTimer(const ScopedTimer&) = delete;
+	ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+	private:
+	Site site;
+	int section;
+	int detail;
+	bool active;
+	Clock::time_point start;
+};
+
+}
+
+void cmdReportPerfTrace(Command* command);
+void cmdExportPerfTrace(Command* command);
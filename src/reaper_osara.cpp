@@ -22,11 +22,14 @@
 #include <string>
 #include <sstream>
 #include <map>
+#include <unordered_map>
 #include <iomanip>
 #include <cassert>
 #include <math.h>
 #include <optional>
 #include <set>
+#include <chrono>
+#include <algorithm>
 #include <WDL/win32_utf8.h>
 #define REAPERAPI_IMPLEMENT
 #include "osara.h"
@@ -41,6 +44,10 @@
 #include "fxChain.h"
 #include "translation.h"
 #include "updateCheck.h"
+#include "fxTree.h"
+#include "itemIndex.h"
+#include "timeline.h"
+#include "perfTrace.h"
 
 using namespace std;
 using namespace fmt::literals;
@@ -129,17 +136,46 @@ void _outputMessage(const string& message, bool interrupt) {
 #else // _WIN32
 
 void _outputMessage(const string& message, bool interrupt) {
-	NSA11yWrapper::osxa11y_announce(message);
+	NSA11yWrapper::osxa11y_announce(message, interrupt);
 }
 
 #endif // _WIN32
 
 bool muteNextMessage = false;
+struct QueuedMessage {
+	string context;
+	string message;
+	// If set, this is called to produce message when it is output.
+	function<string()> getMessage;
+	bool interrupt = true;
+	bool isPending = false;
+	DWORD minInterval = 0;
+	DWORD lastOutputTime = 0;
+};
+QueuedMessage outputQueue[OUTPUT_NUM_SOURCES];
+
+void recordDispatchLatency();
+
 void outputMessage(const string& message, bool interrupt) {
+	perfTrace::ScopedTimer timer(perfTrace::SITE_OUTPUT_MESSAGE);
 	if(muteNextMessage && isHandlingCommand){
 		muteNextMessage = false;
 		return;
 	}
+	recordDispatchLatency();
+	if (interrupt) {
+		// Any queued message is older than this one and would otherwise interrupt
+		// it when flushed. Peak Watcher notifications aren't superseded by other
+		// messages, though, so they're still output, just without interrupting.
+		for (int source = 0; source < OUTPUT_NUM_SOURCES; ++source) {
+			auto& queued = outputQueue[source];
+			if (source == OUTPUT_PEAK_WATCHER) {
+				queued.interrupt = false;
+			} else {
+				queued.isPending = false;
+			}
+		}
+	}
 	_outputMessage(message, interrupt);
 }
 
@@ -147,6 +183,56 @@ void outputMessage(ostringstream& message, bool interrupt) {
 	outputMessage(message.str(), interrupt);
 }
 
+void queueMessage(OutputSource source, const string& message, bool interrupt,
+	const string& context, DWORD minInterval
+) {
+	if(muteNextMessage && isHandlingCommand){
+		muteNextMessage = false;
+		return;
+	}
+	recordDispatchLatency();
+	auto& queued = outputQueue[source];
+	if (!queued.isPending || !context.empty()) {
+		queued.context = context;
+	}
+	queued.message = message;
+	queued.getMessage = nullptr;
+	queued.interrupt = interrupt;
+	queued.minInterval = minInterval;
+	queued.isPending = true;
+}
+
+void queueMessage(OutputSource source, function<string()> getMessage,
+	bool interrupt, const string& context, DWORD minInterval
+) {
+	if(muteNextMessage && isHandlingCommand){
+		muteNextMessage = false;
+		return;
+	}
+	queueMessage(source, string(), interrupt, context, minInterval);
+	outputQueue[source].getMessage = std::move(getMessage);
+}
+
+void flushOutputQueue() {
+	DWORD now = GetTickCount();
+	bool first = true;
+	for (auto& queued : outputQueue) {
+		if (!queued.isPending || now - queued.lastOutputTime < queued.minInterval) {
+			continue;
+		}
+		queued.isPending = false;
+		queued.lastOutputTime = now;
+		if (queued.getMessage) {
+			queued.message = queued.getMessage();
+			queued.getMessage = nullptr;
+		}
+		// Only the first message in a flush may interrupt. Otherwise, a lower
+		// priority message would cut off a higher priority one we just output.
+		_outputMessage(queued.context + queued.message, queued.interrupt && first);
+		first = false;
+	}
+}
+
 bool CallLater::cancel() {
 	// If this->holder is dead, the function has already run or been
 	// cancelled.
@@ -167,9 +253,13 @@ void CALLBACK CallLater::timerProc(HWND hwnd, UINT msg, UINT_PTR event, DWORD ti
 	holder->self = nullptr;
 }
 
-string formatTimeMeasure(int measure, double beat, int measureLength,
-	int timeDenom, bool useTicks, bool isLength, bool useCache,
-	bool includeZeros, bool includeProjectStartOffset
+// The formatTime*To functions append to a buffer rather than returning a
+// string, since they run on every cursor movement and during playback. Their
+// translated format strings are cached.
+
+void formatTimeMeasureTo(fmt::memory_buffer& out, int measure, double beat,
+	int measureLength, int timeDenom, bool useTicks, bool isLength,
+	bool useCache, bool includeZeros, bool includeProjectStartOffset
 ) {
 	int wholeBeat = (int)beat;
 	int beatFractionDenominator;
@@ -177,11 +267,10 @@ string formatTimeMeasure(int measure, double beat, int measureLength,
 		HWND midiEditor = MIDIEditor_GetActive();
 		assert(midiEditor);
 		MediaItem_Take* take = MIDIEditor_GetTake (midiEditor);
-		MediaItem* item = GetMediaItemTake_Item(take);
 		// PPQ is per quarter note, but a beat might not be a quarter note depending
 		// on the time signature denominator. For example, if the time signature is
 		// 6/8, there are only PPQ / 2 ticks per beat.
-		beatFractionDenominator = getItemPPQ(item) * 4 / timeDenom;
+		beatFractionDenominator = getTakePPQ(take) * 4 / timeDenom;
 	} else {
 		beatFractionDenominator = 100;
 	}
@@ -204,21 +293,22 @@ string formatTimeMeasure(int measure, double beat, int measureLength,
 			measure += *(int*)projectconfig_var_addr(nullptr, index);
 		}
 	}
-	ostringstream s;
 	if (!useCache || measure != oldMeasure) {
 		if (isLength) {
 			if (includeZeros || measure != 0) {
 				// Translators: Used when reporting a length of time in measures.
 				// {} will be replaced with the number of measures; e.g.
 				// "2 bars".
-				s << format(
-					translate_plural("{} bar", "{} bars", measure), measure)
-					<< " ";
+				static const CachedFormat msg(_tn("{} bar", "{} bars"));
+				msg.formatPluralTo(out, measure, measure);
+				out.push_back(' ');
 			}
 		} else {
 			// Translators: Used when reporting the measure of a time position.
 			// {} will be replaced with the measure number; e.g. "bar 2".
-			s << format(translate("bar {}"), measure) << " ";
+			static const CachedFormat msg(_t("bar {}"));
+			msg.formatTo(out, measure);
+			out.push_back(' ');
 		}
 		oldMeasure = measure;
 	}
@@ -227,14 +317,16 @@ string formatTimeMeasure(int measure, double beat, int measureLength,
 			if (includeZeros || wholeBeat != 0) {
 				// Translators: Used when reporting a length of time in beats.
 				// {} will be replaced with the number of beats; e.g. "2 beats".
-				s << format(
-					translate_plural("{} beat", "{} beats", wholeBeat),
-					wholeBeat) << " ";
+				static const CachedFormat msg(_tn("{} beat", "{} beats"));
+				msg.formatPluralTo(out, wholeBeat, wholeBeat);
+				out.push_back(' ');
 			}
 		} else {
 			// Translators: Used when reporting the beat of a time position.
 			// {} will be replaced with the beat number; e.g. "beat 2".
-			s << format(translate("beat {}"), wholeBeat) << " ";
+			static const CachedFormat msg(_t("beat {}"));
+			msg.formatTo(out, wholeBeat);
+			out.push_back(' ');
 		}
 		oldBeat = wholeBeat;
 	}
@@ -243,93 +335,105 @@ string formatTimeMeasure(int measure, double beat, int measureLength,
 			if (useTicks) {
 				// Translators: used when reporting a time in ticks. {} will be replaced
 				// with the number of ticks; e.g. "2 ticks".
-				s << format(
-					translate_plural("{} tick", "{} ticks", beatFraction),
-					beatFraction);
+				static const CachedFormat msg(_tn("{} tick", "{} ticks"));
+				msg.formatPluralTo(out, beatFraction, beatFraction);
 			} else {
-				s << beatFraction << "%";
+				fmt::format_to(fmt::appender(out), "{}%", beatFraction);
 			}
 		}
 		oldbeatFraction = beatFraction;
 	}
-	return s.str();
 }
 
-string formatTimeMinsec(double time, bool useCache) {
-	ostringstream s;
+string formatTimeMeasure(int measure, double beat, int measureLength,
+	int timeDenom, bool useTicks, bool isLength, bool useCache,
+	bool includeZeros, bool includeProjectStartOffset
+) {
+	fmt::memory_buffer out;
+	formatTimeMeasureTo(out, measure, beat, measureLength, timeDenom, useTicks,
+		isLength, useCache, includeZeros, includeProjectStartOffset);
+	return string(out.data(), out.size());
+}
+
+// Translators: Used when reporting a time in minutes. {} will be
+// replaced with the number of minutes; e.g. "2 min".
+const CachedFormat FORMAT_MINUTES(_t("{} min"));
+
+void formatTimeMinsecTo(fmt::memory_buffer& out, double time, bool useCache) {
 	int minute = (int)(time / 60);
 	time = fmod(time, 60);
 	if (!useCache || oldMinute != minute) {
-		// Translators: Used when reporting a time in minutes. {} will be
-		// replaced with the number of minutes; e.g. "2 min".
-		s << format(translate("{} min"), minute) << " ";
+		FORMAT_MINUTES.formatTo(out, minute);
+		out.push_back(' ');
 		oldMinute = minute;
 	}
 	// Translators: Used when reporting a time in seconds. {:.3f} will be
 	// replaced with the number of seconds; e.g. "2 sec".
-	s << format(translate("{:#.3f} sec"), time);
-	return s.str();
+	static const CachedFormat msg(_t("{:#.3f} sec"));
+	msg.formatTo(out, time);
 }
 
-string formatTimeSec (double time) {
+void formatTimeSecTo(fmt::memory_buffer& out, double time) {
 	// Translators: Used when reporting a time in seconds. {:.3f} will be
 	// replaced with the number of seconds; e.g. "2 sec".
-	return format(translate("{:.3f} sec"), time);
+	static const CachedFormat msg(_t("{:.3f} sec"));
+	msg.formatTo(out, time);
 }
 
-string formatTimeFrame(double time, bool useCache) {
+// Translators: Used when reporting a time in frames. {} will be
+// replaced with the number of frames; e.g. "2 frames".
+const CachedFormat FORMAT_FRAMES(_tn("{} frame", "{} frames"));
+
+void formatTimeFrameTo(fmt::memory_buffer& out, double time, bool useCache) {
 	int frame = (int)(time * TimeMap_curFrameRate(0, nullptr));
 	if (!useCache || oldFrame != frame) {
 		oldFrame = frame;
-		// Translators: Used when reporting a time in frames. {} will be
-		// replaced with the number of frames; e.g. "2 frames".
-		return format(
-			translate_plural("{} frame", "{} frames", frame), frame);
-	} else {
-		return "";
+		FORMAT_FRAMES.formatPluralTo(out, frame, frame);
 	}
 }
 
-string formatTimeHMSF(double time, bool useCache) {
-	ostringstream s;
+void formatTimeHMSFTo(fmt::memory_buffer& out, double time, bool useCache) {
 	int hour = (int)(time / 3600);
 	time = fmod(time, 3600);
 	if (!useCache || oldHour != hour) {
 		// Translators: used when reporting a time in hours. {} will be replaced
 		// with the number of hours; e.g. "2 hours".
-		s << format(
-			translate_plural("{} hour", "{} hours", hour), hour) << " ";
+		static const CachedFormat msg(_tn("{} hour", "{} hours"));
+		msg.formatPluralTo(out, hour, hour);
+		out.push_back(' ');
 		oldHour = hour;
 	}
 	int minute = (int)(time / 60);
 	time = fmod(time, 60);
 	if (!useCache || oldMinute != minute) {
-		s << format(translate("{} min"), minute) << " ";
+		FORMAT_MINUTES.formatTo(out, minute);
+		out.push_back(' ');
 		oldMinute = minute;
 	}
 	int second = (int)time;
 	if (!useCache || oldSecond != second) {
 		// Translators: Used when reporting a time in seconds. {} will be
 		// replaced with the number of seconds; e.g. "2 sec".
-		s << format(translate("{} sec"), second) << " ";
+		static const CachedFormat msg(_t("{} sec"));
+		msg.formatTo(out, second);
+		out.push_back(' ');
 		oldSecond = second;
 	}
 	time = time - second;
 	int frame = (int)(time * TimeMap_curFrameRate(0, nullptr));
 	if (!useCache || oldFrame != frame) {
-		s << format(
-			translate_plural("{} frame", "{} frames", frame), frame);
+		FORMAT_FRAMES.formatPluralTo(out, frame, frame);
 		oldFrame = frame;
 	}
-	return s.str();
 }
 
-string formatTimeSample(double time) {
+void formatTimeSampleTo(fmt::memory_buffer& out, double time) {
 	char buf[20];
 	format_timestr_pos(time, buf, sizeof(buf), 4);
 	// Translators: Used when reporting a time in samples. {} will be replaced
 	// with the number of samples; e.g. "2 samples".
-	return format(translate("{} samples"), buf);
+	static const CachedFormat msg(_t("{} samples"));
+	msg.formatTo(out, buf);
 }
 
 TimeFormat getTimeFormat(TimeFormat timeFormat) {
@@ -368,7 +472,7 @@ string formatTime(double time, TimeFormat timeFormat,
 	const bool useCache = cache == FT_USE_CACHE ||
 		(cache == FT_CACHE_DEFAULT && !settings::reportFullTimeMovement);
 	timeFormat = getTimeFormat(timeFormat);
-	string s;
+	fmt::memory_buffer s;
 	if (includeProjectStartOffset && timeFormat != TF_MEASURE &&
 			timeFormat != TF_MEASURETICK && timeFormat != TF_SAMPLE) {
 		time += GetProjectTimeOffset(nullptr, false);
@@ -381,34 +485,34 @@ string formatTime(double time, TimeFormat timeFormat,
 			int timeDenom;
 			double beat = TimeMap2_timeToBeats(nullptr, time, &measure, &measureLength,
 				nullptr, &timeDenom);
-			s = formatTimeMeasure(measure, beat, measureLength, timeDenom,
+			formatTimeMeasureTo(s, measure, beat, measureLength, timeDenom,
 				timeFormat == TF_MEASURETICK, false, useCache,
 				includeZeros, includeProjectStartOffset);
 			break;
 		}
 		case TF_MINSEC: {
 			// Minutes:seconds
-			s = formatTimeMinsec(time, useCache);
+			formatTimeMinsecTo(s, time, useCache);
 			break;
 		}
 		case TF_SEC: {
 			// Seconds
-			s = formatTimeSec(time);
+			formatTimeSecTo(s, time);
 			break;
 		}
 		case TF_FRAME: {
 			// Frames
-			s = formatTimeFrame(time, useCache);
+			formatTimeFrameTo(s, time, useCache);
 			break;
 		}
 		case TF_HMSF: {
 			// Hours:minutes:seconds:frames
-			s = formatTimeHMSF(time, useCache);
+			formatTimeHMSFTo(s, time, useCache);
 			break;
 		}
 		case TF_SAMPLE: {
 			// Samples
-			s = formatTimeSample(time);
+			formatTimeSampleTo(s, time);
 			break;
 		}
 		default:
@@ -416,7 +520,7 @@ string formatTime(double time, TimeFormat timeFormat,
 	}
 	// #31: Clear cache for other units to avoid confusion if they are used later.
 	resetTimeCache(timeFormat);
-	return s;
+	return string(s.data(), s.size());
 }
 
 void resetTimeCache(TimeFormat excludeFormat) {
@@ -598,6 +702,103 @@ bool isTrackFxBypassed(MediaTrack* track) {
 	return *(int*)GetSetMediaTrackInfo(track, "I_FXEN", nullptr) == 0;
 }
 
+enum TrackState {
+	TS_MUTED,
+	TS_SOLOED,
+	TS_DEFEATING_SOLO,
+	TS_ARMED,
+	TS_MONITORED,
+	TS_PHASE_INVERTED,
+	TS_SELECTED,
+	TS_NUM_STATES
+};
+
+// A snapshot of the mute, solo, etc. state of all tracks, stored as one bit
+// set per state. Reports about these states read from this rather than
+// querying every track each time. The snapshot is rebuilt when the project
+// state change count changes, the project is switched or the control surface
+// tells us something changed.
+class TrackStateSnapshot {
+	public:
+	static const TrackStateSnapshot& get() {
+		static TrackStateSnapshot snapshot;
+		ReaProject* project = EnumProjects(-1, nullptr, 0);
+		int stateCount = GetProjectStateChangeCount(project);
+		if (!isValid || project != snapshot.project ||
+				stateCount != snapshot.stateCount) {
+			snapshot.build(project, stateCount);
+			isValid = true;
+		}
+		return snapshot;
+	}
+
+	static void invalidate() {
+		isValid = false;
+	}
+
+	int trackCount() const {
+		return (int)this->states[0].size();
+	}
+
+	// index is 0 based.
+	bool has(int index, TrackState state) const {
+		return this->states[state][index];
+	}
+
+	bool masterHas(TrackState state) const {
+		return this->masterStates[state];
+	}
+
+	// The number of tracks (not including master) with this state.
+	int count(TrackState state) const {
+		return this->counts[state];
+	}
+
+	private:
+	void build(ReaProject* project, int stateCount) {
+		this->project = project;
+		this->stateCount = stateCount;
+		const int trackCount = CountTracks(nullptr);
+		for (int s = 0; s < TS_NUM_STATES; ++s) {
+			this->states[s].assign(trackCount, false);
+			this->counts[s] = 0;
+		}
+		for (int i = 0; i < trackCount; ++i) {
+			MediaTrack* track = GetTrack(nullptr, i);
+			this->set(i, TS_MUTED, isTrackMuted(track));
+			this->set(i, TS_SOLOED, isTrackSoloed(track));
+			this->set(i, TS_DEFEATING_SOLO, isTrackDefeatingSolo(track));
+			this->set(i, TS_ARMED, isTrackArmed(track));
+			this->set(i, TS_MONITORED, isTrackMonitored(track));
+			this->set(i, TS_PHASE_INVERTED, isTrackPhaseInverted(track));
+			this->set(i, TS_SELECTED, isTrackSelected(track));
+		}
+		// We only ever report mute, solo and selection for master.
+		MediaTrack* master = GetMasterTrack(nullptr);
+		this->masterStates[TS_MUTED] = isTrackMuted(master);
+		this->masterStates[TS_SOLOED] = isTrackSoloed(master);
+		this->masterStates[TS_SELECTED] = isTrackSelected(master);
+	}
+
+	void set(int index, TrackState state, bool value) {
+		if (value) {
+			this->states[state][index] = true;
+			++this->counts[state];
+		}
+	}
+
+	static inline bool isValid = false;
+	ReaProject* project = nullptr;
+	int stateCount = 0;
+	vector<bool> states[TS_NUM_STATES];
+	bool masterStates[TS_NUM_STATES] = {};
+	int counts[TS_NUM_STATES] = {};
+};
+
+void invalidateTrackStateSnapshot() {
+	TrackStateSnapshot::invalidate();
+}
+
 bool isTrackSelected(MediaTrack* track) {
 	return *(int*)GetSetMediaTrackInfo(track, "I_SELECTED", nullptr);
 }
@@ -997,23 +1198,28 @@ void postGoToTrack(int command, MediaTrack* track) {
 			s << " " << translate("free item positioning");
 		}
 	}
-	int count;
-	if (settings::reportFx && (count = TrackFX_GetCount(track)) > 0) {
-		// Translators: Reported when navigating tracks before listing the effects on
-		// the track.
-		s << "; " << translate("FX:") << " ";
-		char name[256];
-		for (int f = 0; f < count; ++f) {
-			if (f > 0)
+	if (settings::reportFx) {
+		bool first = true;
+		for (const FxTree::Entry& fx: FxTree::get(track).getEntries()) {
+			if (fx.level > 1 || fx.isRec) {
+				// We only report the top level of the normal chain.
+				continue;
+			}
+			if (first) {
+				// Translators: Reported when navigating tracks before listing the effects on
+				// the track.
+				s << "; " << translate("FX:") << " ";
+				first = false;
+			} else {
 				s << ", ";
-			TrackFX_GetFXName(track, f, name, sizeof(name));
-			shortenFxName(name, s);
-			if (!TrackFX_GetEnabled(track, f)) {
+			}
+			shortenFxName(fx.name.c_str(), s);
+			if (!fx.enabled) {
 				s << " " << translate("bypassed");
 			}
-			int deltaParam = TrackFX_GetParamFromIdent(track, f, ":delta");
-			if (deltaParam != -1 &&
-					TrackFX_GetParam(track, f, deltaParam, nullptr, nullptr)) {
+			if (fx.deltaParam != -1 &&
+					TrackFX_GetParam(track, fx.fxIndex, fx.deltaParam, nullptr,
+						nullptr)) {
 				s << " " << translate("delta");
 			}
 		}
@@ -1255,10 +1461,15 @@ void postCursorMovement(int command) {
 }
 
 void postCursorMovementScrub(int command) {
-	if (settings::reportScrub)
-		postCursorMovement(command);
-	else
-		fakeFocus = FOCUS_RULER; // Set this even if we aren't reporting.
+	fakeFocus = FOCUS_RULER; // Set this even if we aren't reporting.
+	// Scrubbing is usually done by holding a key, so queue the message to avoid
+	// flooding the screen reader.
+	if (settings::reportScrub && shouldReportTimeMovement()) {
+		// Format the position when the message is output. Otherwise, the time
+		// cache would be updated for positions which never get reported, so bar
+		// and beat changes could be omitted from the message which is.
+		queueMessage(OUTPUT_SCRUB, [] { return formatCursorPosition(); });
+	}
 }
 
 void postItemNormalize(int command) {
@@ -1632,18 +1843,20 @@ void postToggleRepeat(int command) {
 void addTakeFxNames(MediaItem_Take* take, ostringstream &s) {
 	if (!settings::reportFx)
 		return;
-	int count = TakeFX_GetCount(take);
-	if (count == 0)
-		return;
-	// Translators: Reported when switching takes before listing the effects on
-	// the take.
-	s << "; " << translate("FX:") << " ";
-	char name[256];
-	for (int f = 0; f < count; ++f) {
-		if (f > 0)
+	bool first = true;
+	for (const FxTree::Entry& fx: FxTree::get(take).getEntries()) {
+		if (fx.level > 1) {
+			continue;
+		}
+		if (first) {
+			// Translators: Reported when switching takes before listing the effects on
+			// the take.
+			s << "; " << translate("FX:") << " ";
+			first = false;
+		} else {
 			s << ", ";
-		TakeFX_GetFXName(take, f, name, sizeof(name));
-		shortenFxName(name, s);
+		}
+		shortenFxName(fx.name.c_str(), s);
 	}
 }
 
@@ -2802,7 +3015,6 @@ map<int, MExplorerPostExecute> mExplorerPostCommands{
 	{42177, postMExplorerChangeVolume}, // Preview: increase volume by 1 dB
 };
 
-map<int, PostCommandExecute> postCommandsMap;
 map<int, string> POST_COMMAND_MESSAGES = {
 	{40625, _t("set selection start")}, // Time selection: Set start point
 	{40222, _t("set loop start")}, // Loop points: Set start point
@@ -2839,8 +3051,6 @@ const set<int> MOVE_FROM_PLAY_CURSOR_COMMANDS = {
 40647, // View: Move cursor right to grid division
 };
 
-map<int, PostCommandExecute> midiPostCommandsMap;
-map<int, pair<PostCommandExecute, bool>> midiEventListPostCommandsMap;
 map<int, string> MIDI_POST_COMMAND_MESSAGES = {
 	{40204, _t("grid whole")}, // Grid: Set to 1
 	{40203, _t("grid half")}, // Grid: Set to 1/2
@@ -2930,6 +3140,128 @@ map<pair<int, int>, ToggleCommandMessage> TOGGLE_COMMAND_MESSAGES = {
 	{{MIDI_EDITOR_SECTION, 41295}, {_t("length matching grid"), nullptr}}, // Set length for next inserted note: grid
 };
 
+// The maps above are convenient to maintain, but handling every key press
+// would mean several tree lookups. Instead, everything we know about a
+// (section, command) pair is merged into a single DispatchEntry in an
+// immutable open addressing hash table, built by buildBuiltinDispatchEntries()
+// and delayedInit().
+enum DispatchFlags {
+	DF_MOVE_FROM_PLAY_CURSOR = 1 << 0,
+	DF_CHANGES_VALUE_IN_MIDI_EVENT_LIST = 1 << 1,
+};
+
+struct DispatchEntry {
+	int section = 0;
+	// 0 means this slot is empty.
+	int command = 0;
+	Command* osaraCommand = nullptr;
+	PostCommandExecute postExecute = nullptr;
+	MExplorerPostExecute mExplorerPostExecute = nullptr;
+	const char* message = nullptr;
+	const ToggleCommandMessage* toggleMessage = nullptr;
+	unsigned int flags = 0;
+};
+
+// Bucket b counts dispatches which took less than 2^b ms to produce their
+// first message. The last bucket counts everything slower.
+const int NUM_LATENCY_BUCKETS = 12;
+struct DispatchLatency {
+	unsigned int counts[NUM_LATENCY_BUCKETS] = {};
+	unsigned int total = 0;
+	double maxMs = 0;
+};
+
+class DispatchTable {
+	public:
+	void build(const map<pair<int, int>, DispatchEntry>& entries) {
+		size_t size = 16;
+		// Keep the load factor at most 0.5 so probes stay short.
+		while (size < entries.size() * 2) {
+			size *= 2;
+		}
+		this->mask = size - 1;
+		this->slots.assign(size, DispatchEntry());
+		this->latency.assign(size, DispatchLatency());
+		for (const auto& [key, entry] : entries) {
+			if (entry.command == 0) {
+				continue;
+			}
+			size_t slot = hash(entry.section, entry.command) & this->mask;
+			while (this->slots[slot].command != 0) {
+				slot = (slot + 1) & this->mask;
+			}
+			this->slots[slot] = entry;
+		}
+	}
+
+	const DispatchEntry* find(int section, int command) const {
+		if (this->slots.empty() || command == 0) {
+			return nullptr;
+		}
+		size_t slot = hash(section, command) & this->mask;
+		for (;;) {
+			const DispatchEntry& entry = this->slots[slot];
+			if (entry.command == 0) {
+				return nullptr;
+			}
+			if (entry.command == command && entry.section == section) {
+				return &entry;
+			}
+			slot = (slot + 1) & this->mask;
+		}
+	}
+
+	DispatchLatency& latencyFor(const DispatchEntry* entry) {
+		return this->latency[entry - this->slots.data()];
+	}
+
+	// Calls func(entry, latency) for every entry which has recorded latency.
+	void forEachLatency(auto func) const {
+		for (size_t s = 0; s < this->slots.size(); ++s) {
+			if (this->latency[s].total > 0) {
+				func(this->slots[s], this->latency[s]);
+			}
+		}
+	}
+
+	private:
+	static size_t hash(int section, int command) {
+		uint64_t key = ((uint64_t)(unsigned int)section << 32) |
+			(unsigned int)command;
+		// Fibonacci hashing spreads sequential command ids across the table.
+		return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 32);
+	}
+
+	vector<DispatchEntry> slots;
+	vector<DispatchLatency> latency;
+	size_t mask = 0;
+};
+
+DispatchTable dispatchTable;
+
+// The entry being dispatched by handleCommand and when that began, used to
+// measure how long it takes to report something.
+const DispatchEntry* dispatchingEntry = nullptr;
+chrono::steady_clock::time_point dispatchStartTime;
+
+void recordDispatchLatency() {
+	if (!dispatchingEntry) {
+		return;
+	}
+	double ms = chrono::duration<double, milli>(
+		chrono::steady_clock::now() - dispatchStartTime).count();
+	DispatchLatency& latency = dispatchTable.latencyFor(dispatchingEntry);
+	int bucket = 0;
+	while (bucket < NUM_LATENCY_BUCKETS - 1 && ms >= (double)(1 << bucket)) {
+		++bucket;
+	}
+	++latency.counts[bucket];
+	++latency.total;
+	latency.maxMs = max(latency.maxMs, ms);
+	// We only measure until the first message.
+	dispatchingEntry = nullptr;
+}
+
 /*** Code related to context menus and other UI that isn't just actions.
  * This includes code to access REAPER context menus, but also code to display
  * our own in some cases where REAPER doesn't provide one.
@@ -2987,19 +3319,78 @@ bool isClassName(HWND hwnd, string className) {
 
 #ifdef _WIN32
 
-HWND getSendContainer(HWND hwnd) {
-	if (!isClassName(hwnd, "Button")) {
-		return nullptr;
+// The kinds of window OSARA treats specially. Identifying these means fetching
+// and comparing class names, sometimes of parents and siblings too, which adds
+// up when done for every key press and focus event. So, each window is
+// classified once and the result is cached until the window is destroyed.
+enum WindowKind : uint8_t {
+	// Set for any window which has been classified, even if it isn't any of the
+	// kinds below.
+	WK_CLASSIFIED = 1 << 0,
+	WK_TRACK_VIEW = 1 << 1,
+	WK_LIST_VIEW = 1 << 2,
+	WK_MIDI_EVENT_LIST = 1 << 3,
+	// A dialog, which might be an FX dialog.
+	WK_DIALOG = 1 << 4,
+	// A group box, which is never a preference control.
+	WK_GROUP_BOX = 1 << 5,
+	// A button for a send in the Track I/O window. Its parent is the send
+	// container.
+	WK_SEND_BUTTON = 1 << 6,
+};
+
+unordered_map<HWND, uint8_t> windowKinds;
+
+uint8_t classifyWindow(HWND hwnd) {
+	char className[50];
+	if (GetClassName(hwnd, className, sizeof(className)) == 0) {
+		return 0;
 	}
-	hwnd = GetWindow(hwnd, GW_HWNDPREV);
-	if (!isClassName(hwnd, "Static")) {
-		return nullptr;
+	uint8_t kinds = WK_CLASSIFIED;
+	if (strcmp(className, "REAPERTrackListWindow") == 0 ||
+			strcmp(className, "REAPERtrackvu") == 0 ||
+			strcmp(className, "REAPERTCPDisplay") == 0) {
+		kinds |= WK_TRACK_VIEW;
+	} else if (strcmp(className, "SysListView32") == 0) {
+		kinds |= WK_LIST_VIEW;
+		if (isClassName(GetAncestor(hwnd, GA_PARENT), "REAPERmidieditorwnd")) {
+			kinds |= WK_MIDI_EVENT_LIST;
+		}
+	} else if (strcmp(className, WCS_DIALOG) == 0) {
+		kinds |= WK_DIALOG;
+	} else if (strcmp(className, "Button") == 0) {
+		if ((GetWindowLong(hwnd, GWL_STYLE) & BS_GROUPBOX) == BS_GROUPBOX) {
+			kinds |= WK_GROUP_BOX;
+		} else if (isClassName(GetWindow(hwnd, GW_HWNDPREV), "Static") &&
+				isClassName(GetAncestor(hwnd, GA_PARENT), "REAPERVirtWndDlgHost")) {
+			kinds |= WK_SEND_BUTTON;
+		}
+	}
+	return kinds;
+}
+
+uint8_t getWindowKinds(HWND hwnd) {
+	if (!hwnd) {
+		return 0;
+	}
+	auto it = windowKinds.find(hwnd);
+	if (it != windowKinds.end()) {
+		return it->second;
+	}
+	uint8_t kinds = classifyWindow(hwnd);
+	if (kinds) {
+		// Don't cache a failure, since that happens for invalid windows and a
+		// window could later be created with the same handle.
+		windowKinds[hwnd] = kinds;
 	}
-	hwnd = GetAncestor(hwnd, GA_PARENT);
-	if (!isClassName(hwnd, "REAPERVirtWndDlgHost")) {
+	return kinds;
+}
+
+HWND getSendContainer(HWND hwnd) {
+	if (!(getWindowKinds(hwnd) & WK_SEND_BUTTON)) {
 		return nullptr;
 	}
-	return hwnd;
+	return GetAncestor(hwnd, GA_PARENT);
 }
 
 void sendMenu(HWND sendWindow) {
@@ -3068,20 +3459,15 @@ void sendMenu(HWND sendWindow) {
 }
 
 bool isTrackViewWindow(HWND hwnd) {
-	WCHAR className[22] = L"\0";
-	GetClassNameW(hwnd, className, ARRAYSIZE(className));
-	return wcscmp(className, L"REAPERTrackListWindow") == 0
-		|| wcscmp(className, L"REAPERtrackvu") == 0
-		|| wcscmp(className, L"REAPERTCPDisplay") == 0;
+	return getWindowKinds(hwnd) & WK_TRACK_VIEW;
 }
 
 bool isListView(HWND hwnd) {
-	return isClassName(hwnd, "SysListView32");
+	return getWindowKinds(hwnd) & WK_LIST_VIEW;
 }
 
 bool isMidiEditorEventListView(HWND hwnd) {
-	return isListView(hwnd)
-		&& isClassName(GetAncestor(hwnd, GA_PARENT), "REAPERmidieditorwnd");
+	return getWindowKinds(hwnd) & WK_MIDI_EVENT_LIST;
 }
 
 void sendNameChangeEventToMidiEditorEventListItem(HWND hwnd) {
@@ -3106,8 +3492,7 @@ HWND getPreferenceDescHwnd(HWND pref) {
 		return nullptr;
 	}
 	// Group boxes aren't preference controls.
-	if (isClassName(pref, "Button")
-			&& (GetWindowLong(pref, GWL_STYLE) & BS_GROUPBOX) == BS_GROUPBOX) {
+	if (getWindowKinds(pref) & WK_GROUP_BOX) {
 		return nullptr;
 	}
 	// if the control id for the description isn't in this root window, it's not
@@ -3147,6 +3532,7 @@ bool maybeAnnotatePreferenceDescription() {
 // Handle keyboard keys which can't be bound to actions.
 // REAPER's "accelerator" hook isn't enough because it doesn't get called in some windows.
 LRESULT CALLBACK keyboardHookProc(int code, WPARAM wParam, LPARAM lParam) {
+	perfTrace::ScopedTimer timer(perfTrace::SITE_KEYBOARD_HOOK, 0, (int)wParam);
 	const bool isKeyDown = !(lParam & 0x80000000);
 	if (!isKeyDown || code != HC_ACTION || (
 		wParam != VK_APPS && wParam != VK_CONTROL &&
@@ -3428,9 +3814,12 @@ void moveToItem(int direction, bool clearSelection=true, bool select=true) {
 	if (!track)
 		return;
 	double cursor = GetCursorPosition();
-	int count = CountTrackMediaItems(track);
+	const TrackItemIndex& items = TrackItemIndex::get(track);
+	int count = items.count();
 	double pos;
-	int start = direction == 1 ? 0 : count - 1;
+	// Jump straight to the first item which could be in the right direction.
+	int start = direction == 1 ? items.findFirstStartingAtOrAfter(cursor) :
+		items.findLastStartingAtOrBefore(cursor);
 	if (currentItem && ValidatePtr((void*)currentItem, "MediaItem*")
 		&& (MediaTrack*)GetSetMediaItemInfo(currentItem, "P_TRACK", nullptr) == track
 	) {
@@ -3450,8 +3839,8 @@ void moveToItem(int direction, bool clearSelection=true, bool select=true) {
 		currentItem = nullptr; // Invalid.
 
 	for (int i = start; 0 <= i && i < count; i += direction) {
-		MediaItem* item = GetTrackMediaItem(track, i);
-		pos = *(double*)GetSetMediaItemInfo(item, "D_POSITION", nullptr);
+		MediaItem* item = items[i].item;
+		pos = items[i].start;
 		if (direction == 1 ? pos < cursor : pos > cursor)
 			continue; // Not the right direction.
 		currentItem = item;
@@ -3465,6 +3854,8 @@ void moveToItem(int direction, bool clearSelection=true, bool select=true) {
 			GetSetMediaItemInfo(item, "B_UISEL", &bTrue);
 		if ((clearSelection || select) && makeUndoPoint)
 			Undo_EndBlock(translate("Change Item Selection"), 0);
+		// We only changed the selection, so the item index is still valid.
+		TrackItemIndex::keepAfterSelectionChange();
 		SetEditCurPos(pos, true, true); // Seek playback.
 		fakeFocus = FOCUS_ITEM;
 		selectedEnvelopeIsTake = true;
@@ -4039,15 +4430,17 @@ string formatTrackRange(int start, const char* startName,
 		"start"_a=startText, "end"_a=endText);
 }
 
-template <typename Func>
-string formatTracksWithState(const char* prefix, Func checkState,
+// When more tracks than this have a state, a single line report just gives the
+// number of tracks. Listing them wouldn't be useful in speech and would mean
+// fetching the names of many tracks. The full list is available in the
+// multi-line report.
+const int MAX_TRACKS_LISTED_IN_LINE = 10;
+
+string formatTracksWithState(const char* prefix, TrackState state,
 	bool includeMaster, bool multiLine, bool outputIfNone = true
 ) {
 	const char* separator = multiLine ? "\r\n" : ", ";
-	int rangeStart = 0;
-	char* startingTrackName;
-	char* prevTrackName;
-	bool inActiveRange = false;
+	const TrackStateSnapshot& snapshot = TrackStateSnapshot::get();
 	ostringstream s;
 
 	if (prefix) {
@@ -4056,76 +4449,66 @@ string formatTracksWithState(const char* prefix, Func checkState,
 	}
 
 	int count = 0;
-	if(includeMaster) {
-		MediaTrack* master = GetMasterTrack(nullptr);
-		if (checkState(master)) {
-			++count;
-			s << translate("master") << separator;
-		}
+	if (includeMaster && snapshot.masterHas(state)) {
+		++count;
+		s << translate("master") << separator;
+	}
+
+	if (!multiLine && snapshot.count(state) > MAX_TRACKS_LISTED_IN_LINE) {
+		// Translators: Used when reporting all tracks which are muted, soloed, etc.
+		// if there are too many to list them. {} will be replaced with the number
+		// of tracks; e.g. "Muted: 25 tracks".
+		s << format(translate_plural("{} track", "{} tracks",
+			snapshot.count(state)), snapshot.count(state));
+		return s.str();
 	}
 
-	int trackCount = CountTracks(0);
+	auto getName = [](int index) {
+		MediaTrack* track = GetTrack(nullptr, index);
+		return (char*)GetSetMediaTrackInfo(track, "P_NAME", nullptr);
+	};
+	// If no tracks have this state, don't bother walking the tracks.
+	int trackCount = snapshot.count(state) > 0 ? snapshot.trackCount() : 0;
 	for (int i = 0; i < trackCount; ++i) {
+		if (!snapshot.has(i, state)) {
+			continue;
+		}
 		const int trackNumber = i + 1;
-		MediaTrack* track = GetTrack(nullptr, i);
-		char* name = (char*)GetSetMediaTrackInfo(track, "P_NAME", nullptr);
 		if (multiLine) {
 			// We don't summarise ranges in this case. We output each track.
-			if (checkState(track)) {
-				++count;
-				if (count > 1) {
-					s << separator;
-				}
+			++count;
+			if (count > 1) {
+				s << separator;
+			}
+			char* name = getName(i);
+			if (settings::reportTrackNumbers) {
+				s << trackNumber;
+			}
+			if (name && name[0]) {
 				if (settings::reportTrackNumbers) {
-					s << trackNumber;
-				}
-				if (name && name[0]) {
-					if (settings::reportTrackNumbers) {
-						s << " ";
-					}
-					s << name;
-				} else if (!settings::reportTrackNumbers) {
-					// There's no name and track number reporting is disabled. We report
-					// the number in lieu of the name.
-					s << i + 1;
+					s << " ";
 				}
+				s << name;
+			} else if (!settings::reportTrackNumbers) {
+				// There's no name and track number reporting is disabled. We report
+				// the number in lieu of the name.
+				s << trackNumber;
 			}
 			continue;
 		}
-
-		if (checkState(track)) {
-			prevTrackName = name;
-			if (trackNumber == trackCount) {
-				// No more tracks. Output the last range.
-				++count;
-				if (count > 1) {
-					s << separator;
-				}
-				s << formatTrackRange(inActiveRange ? rangeStart : trackCount,
-					inActiveRange ? startingTrackName : name, trackCount, name, separator);
-				break;
-			}
-			if (inActiveRange) {
-				// Not interested in tracks within a range, only those at each end.
-				continue;
-			}
-			inActiveRange = true;
-			rangeStart = trackNumber;
-			startingTrackName = name;
-		} else {
-			if (inActiveRange) {
-				// This track doesn't match. Output the previous range.
-				++count;
-				if (count > 1) {
-					s << separator;
-				}
-				s << formatTrackRange(rangeStart, startingTrackName, i, prevTrackName,
-					separator);
-				startingTrackName = nullptr;
-				rangeStart = 0;
-				inActiveRange = false;
-			}
+		// Find the end of this range of matching tracks. We only need the names of
+		// the tracks at each end.
+		int last = i;
+		while (last + 1 < trackCount && snapshot.has(last + 1, state)) {
+			++last;
+		}
+		++count;
+		if (count > 1) {
+			s << separator;
 		}
+		s << formatTrackRange(trackNumber, getName(i), last + 1, getName(last),
+			separator);
+		i = last;
 	}
 
 	if (count == 0) {
@@ -4139,12 +4522,11 @@ string formatTracksWithState(const char* prefix, Func checkState,
 	return s.str();
 }
 
-template <typename Func>
-void reportTracksWithState(const char* prefix, Func checkState,
+void reportTracksWithState(const char* prefix, TrackState state,
 	bool includeMaster
 ) {
 	bool multiLine = lastCommandRepeatCount == 1;
-	string s = formatTracksWithState(multiLine ? nullptr : prefix, checkState,
+	string s = formatTracksWithState(multiLine ? nullptr : prefix, state,
 		includeMaster, multiLine);
 	if (multiLine) {
 		reviewMessage(prefix, s.c_str());
@@ -4154,16 +4536,16 @@ void reportTracksWithState(const char* prefix, Func checkState,
 }
 
 void cmdReportMutedTracks(Command* command) {
-	reportTracksWithState(translate("Muted"), isTrackMuted, /* includeMaster */ true);
+	reportTracksWithState(translate("Muted"), TS_MUTED, /* includeMaster */ true);
 }
 
 void cmdReportSoloedTracks(Command* command) {
 	bool multiLine = lastCommandRepeatCount == 1;
 	ostringstream s;
-	s << formatTracksWithState(translate("soloed"), isTrackSoloed, /* includeMaster */ true,
+	s << formatTracksWithState(translate("soloed"), TS_SOLOED, /* includeMaster */ true,
 		multiLine);
 	string defeat = formatTracksWithState(translate("defeating solo"),
-		isTrackDefeatingSolo, /* includeMaster */ false, multiLine,
+		TS_DEFEATING_SOLO, /* includeMaster */ false, multiLine,
 		/* outputIfNone */ false);
 	if (!defeat.empty()) {
 		s << (multiLine ? "\r\n\r\n" : "; ") << defeat;
@@ -4176,39 +4558,63 @@ void cmdReportSoloedTracks(Command* command) {
 }
 
 void cmdReportArmedTracks(Command* command) {
-	reportTracksWithState(translate("Armed"), isTrackArmed, /* includeMaster */ false);
+	reportTracksWithState(translate("Armed"), TS_ARMED, /* includeMaster */ false);
 }
 
 void cmdReportMonitoredTracks(Command* command) {
-	reportTracksWithState(translate("Monitored"), isTrackMonitored,
+	reportTracksWithState(translate("Monitored"), TS_MONITORED,
 		/* includeMaster */ false);
 }
 
 void cmdReportPhaseInvertedTracks(Command* command) {
-	reportTracksWithState(translate("Phase inverted"), isTrackPhaseInverted,
+	reportTracksWithState(translate("Phase inverted"), TS_PHASE_INVERTED,
 		/* includeMaster */ false);
 }
 
-template <typename Func>
-string formatItemsWithState(Func stateCheck, bool multiLine) {
+// Report the track and item numbers and take names of the selected items.
+// REAPER returns selected items in track order, so we only need to visit the
+// selected items rather than every item in the project.
+string formatSelectedItems(bool multiLine) {
+	const char* separator = multiLine ? "\r\n" : ", ";
+	ostringstream s;
+	int count = CountSelectedMediaItems(nullptr);
+	for (int i = 0; i < count; ++i) {
+		MediaItem* item = GetSelectedMediaItem(nullptr, i);
+		MediaTrack* track = GetMediaItem_Track(item);
+		if (i > 0) {
+			s << separator;
+		}
+		s << (int)(size_t)GetSetMediaTrackInfo(track, "IP_TRACKNUMBER", nullptr) <<
+			"." << (int)(size_t)GetSetMediaItemInfo(item, "IP_ITEMNUMBER", nullptr) + 1;
+		MediaItem_Take* take = GetActiveTake(item);
+		if (take)
+			s << " " << GetTakeName(take);
+	}
+	return s.str();
+}
+
+// Like formatSelectedItems, but only reports items containing pos on selected
+// tracks. This uses the item index rather than checking every item.
+string formatSelectedTrackItemsAt(double pos, bool multiLine) {
 	const char* separator = multiLine ? "\r\n" : ", ";
 	ostringstream s;
 	int count = 0;
 	for (int t = 0; t < CountTracks(nullptr); ++t) {
 		MediaTrack* track = GetTrack(nullptr, t);
-		for (int i = 0; i < CountTrackMediaItems(track); ++i) {
-			MediaItem* item = GetTrackMediaItem(track, i);
-			if (stateCheck(item)) {
+		if (!isTrackSelected(track)) {
+			continue;
+		}
+		TrackItemIndex::get(track).forEachItemAt(pos,
+			[&](int i, const TrackItemIndex::Entry& entry) {
 				++count;
 				if (count > 1) {
 					s << separator;
 				}
 				s << t + 1 << "." << i + 1;
-				MediaItem_Take* take = GetActiveTake(item);
+				MediaItem_Take* take = GetActiveTake(entry.item);
 				if (take)
 					s << " " << GetTakeName(take);
-			}
-		}
+			});
 	}
 	return s.str();
 }
@@ -4254,7 +4660,7 @@ void cmdReportSelection(Command* command) {
 			}
 			s << translate("Selected tracks:") << separator;
 		}
-		s << formatTracksWithState(nullptr, isTrackSelected,
+		s << formatTracksWithState(nullptr, TS_SELECTED,
 			/* includeMaster */ true, multiLine, /* outputIfNone */ multiLine);
 		if (!multiLine && s.tellp() == 0) {
 			s << translate("no selected tracks");
@@ -4268,7 +4674,7 @@ void cmdReportSelection(Command* command) {
 			}
 			s << translate("Selected items:") << separator;
 		}
-		string items = formatItemsWithState(isItemSelected, multiLine);
+		string items = formatSelectedItems(multiLine);
 		if (items.empty()) {
 			s << (multiLine ? translate("none") : translate("no selected items"));
 		} else {
@@ -5050,40 +5456,31 @@ void cmdReportRegionMarkerItems(Command* command) {
 		}
 	};
 	double pos = GetPlayState()? GetPlayPosition():GetCursorPosition();
-	double start,end;
-	bool isrgn;
-	int number;
-	const char* name{nullptr};
-	int idx = 0;
-	while(EnumProjectMarkers(idx++, &isrgn, &start, &end, &name, &number)>0) {
-		if(!(isrgn && start <= pos && pos <= end)) {
-			continue;
-		} 
+	// This is only rebuilt when the project changes, so repeated presses in a
+	// big project don't enumerate every marker each time.
+	static MarkerTimeline timeline;
+	timeline.update();
+	timeline.seek(pos);
+	timeline.forEachRegionAt(pos, [&](const MarkerTimeline::Entry& region) {
 		separate();
-		if(name[0]) {
-			s << name ;
+		if(!region.name.empty()) {
+			s << region.name;
 		} else {
 			// Translators: used to report an unnamed region. {} is replaced with the region number.  
-			s << format(translate("region {}"), number);
+			s << format(translate("region {}"), region.number);
 		}
-	}
-	int markerIdx;
-	GetLastMarkerAndCurRegion(nullptr, pos, &markerIdx, nullptr);
-	if(markerIdx >=0) {
-		EnumProjectMarkers(markerIdx, nullptr, nullptr, nullptr, &name, &number);
+	});
+	if (const MarkerTimeline::Entry* marker = timeline.getLastMarker()) {
 		separate();
-		if (name[0]) {
-			s << name;
+		if (!marker->name.empty()) {
+			s << marker->name;
 		} else {
 			// Translators: used to report an unnamed marker. {} is replaced with the marker number.  
-			s << format(translate("marker {}"), number);
+			s << format(translate("marker {}"), marker->number);
 		}
 	}
 	separate();
-	s << formatItemsWithState([pos](MediaItem* item) -> bool{
-		MediaTrack* track = GetMediaItem_Track(item);
-		return (isTrackSelected(track) && isPosInItem(pos, item));
-	}, multiLine);
+	s << formatSelectedTrackItemsAt(pos, multiLine);
 	if(multiLine) {
 		// Translators: The title of the review message for the action "OSARA: Report regions, last project marker and items on selected tracks at current position".
 		reviewMessage(translate("At Current Position"), s.str().c_str());
@@ -5154,6 +5551,46 @@ void cmdJumpToTime(Command* command) {
 	}, 50);
 }
 
+void cmdReportDispatchLatency(Command* command) {
+	vector<pair<const DispatchEntry*, const DispatchLatency*>> measured;
+	dispatchTable.forEachLatency([&measured](const DispatchEntry& entry,
+			const DispatchLatency& latency) {
+		measured.push_back({&entry, &latency});
+	});
+	if (measured.empty()) {
+		outputMessage(translate("no command latency recorded"));
+		return;
+	}
+	// Slowest first.
+	sort(measured.begin(), measured.end(), [](auto& a, auto& b) {
+		return a.second->maxMs > b.second->maxMs;
+	});
+	ostringstream s;
+	s << fixed << setprecision(1);
+	for (auto& [entry, latency] : measured) {
+		// Find the bucket containing the 90th percentile.
+		unsigned int threshold = (latency->total * 9 + 9) / 10;
+		unsigned int count = 0;
+		int bucket = 0;
+		for (; bucket < NUM_LATENCY_BUCKETS - 1; ++bucket) {
+			count += latency->counts[bucket];
+			if (count >= threshold) {
+				break;
+			}
+		}
+		KbdSectionInfo* section = SectionFromUniqueID(entry->section);
+		s << getActionName(entry->command, section, false) << ": " <<
+			// Translators: Used when reporting command latency. {count} will be
+			// replaced with the number of times the command was run, {p90} with the
+			// time within which 90% of them reported and {max} with the slowest
+			// time; e.g. "12 runs, 90% within 4 ms, max 7.3 ms".
+			format(translate("{count} runs, 90% within {p90} ms, max {max} ms"),
+				"count"_a=latency->total, "p90"_a=1 << bucket,
+				"max"_a=latency->maxMs) << "\r\n";
+	}
+	reviewMessage(translate("Command latency"), s.str().c_str());
+}
+
 #define DEFACCEL {0, 0, 0}
 
 Command COMMANDS[] = {
@@ -5304,9 +5741,13 @@ Command COMMANDS[] = {
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher value for first watcher second channel")}, "OSARA_REPORTPEAKWATCHERT1C2", cmdReportPeakWatcherW1C2},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher value for second watcher first channel")}, "OSARA_REPORTPEAKWATCHERT2C1", cmdReportPeakWatcherW2C1},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher value for second watcher second channel")}, "OSARA_REPORTPEAKWATCHERT2C2", cmdReportPeakWatcherW2C2},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher values for all channels of first watcher")}, "OSARA_REPORTPEAKWATCHERT1ALL", cmdReportPeakWatcherW1All},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher values for all channels of second watcher")}, "OSARA_REPORTPEAKWATCHERT2ALL", cmdReportPeakWatcherW2All},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Reset Peak Watcher first watcher")}, "OSARA_RESETPEAKWATCHERT1", cmdResetPeakWatcherW1},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Reset Peak Watcher second watcher")}, "OSARA_RESETPEAKWATCHERT2", cmdResetPeakWatcherW2},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Pause/resume Peak Watcher")}, "OSARA_PAUSEPEAKWATCHER", cmdPausePeakWatcher},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Toggle Peak Watcher project over detector")}, "OSARA_TOGGLEOVERDETECTOR", cmdToggleOverDetector},
+	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report Peak Watcher project over detector results")}, "OSARA_REPORTOVERDETECTOR", cmdReportOverDetector},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report ripple editing mode")}, "OSARA_REPORTRIPPLE", cmdReportRippleMode},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report muted tracks")}, "OSARA_REPORTMUTED", cmdReportMutedTracks},
 	{MAIN_SECTION, {DEFACCEL, _t("OSARA: Report soloed tracks")}, "OSARA_REPORTSOLOED", cmdReportSoloedTracks},
@@ -5345,6 +5786,9 @@ Command COMMANDS[] = {
 	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: About")}, "OSARA_ABOUT", cmdAbout},
 	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: Report groups for current track")}, "OSARA_REPORTTRACKGROUPS", cmdReportTrackGroups},
 	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: Mute next message from OSARA")}, "OSARA_MUTENEXTMESSAGE", cmdMuteNextMessage},
+	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: Report command latency")}, "OSARA_REPORTCOMMANDLATENCY", cmdReportDispatchLatency},
+	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: Report performance trace")}, "OSARA_REPORTPERFTRACE", cmdReportPerfTrace},
+	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: Export performance trace to CSV file")}, "OSARA_EXPORTPERFTRACE", cmdExportPerfTrace},
 	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: Report regions, last project marker and items on selected tracks at current position")}, "OSARA_REPORTREGIONMARKERITEMS",cmdReportRegionMarkerItems},
 	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: Go to first track")}, "OSARA_GOTOFIRSTTRACK", cmdGoToFirstTrack},
 	{ MAIN_SECTION, {DEFACCEL, _t("OSARA: Go to last track")}, "OSARA_GOTOLASTTRACK", cmdGoToLastTrack},
@@ -5386,76 +5830,74 @@ Command COMMANDS[] = {
 	{ MEDIA_EXPLORER_SECTION, {DEFACCEL, _t("OSARA: Mute next message from OSARA")}, "OSARA_MX_MUTENEXTMESSAGE", cmdMuteNextMessage},
 	{0, {}, nullptr, nullptr},
 };
-map<pair<int, int>, Command*> commandsMap;
 
 /*** Initialisation, termination and inner workings. */
 
 bool isHandlingCommand = false;
 
-bool handlePostCommand(int section, int command, int val, int valHw,
+bool handlePostCommand(const DispatchEntry* entry, int val, int valHw,
 	int relMode, HWND hwnd
 ) {
-	if (section==MAIN_SECTION) {
-		const auto postIt = postCommandsMap.find(command);
-		if (postIt != postCommandsMap.end()) {
+	if (!entry) {
+		return false;
+	}
+	perfTrace::ScopedTimer timer(perfTrace::SITE_POST_COMMAND, entry->section,
+		entry->command);
+	const int command = entry->command;
+	if (entry->section==MAIN_SECTION) {
+		if (entry->postExecute) {
 			isHandlingCommand = true;
-			if (settings::moveFromPlayCursor) {
-				const auto cursorIt = MOVE_FROM_PLAY_CURSOR_COMMANDS.find(command);
-				if (cursorIt != MOVE_FROM_PLAY_CURSOR_COMMANDS.end()) {
-					if (GetPlayState() & 1) { // Playing
-						SetEditCurPos(GetPlayPosition(), false, false);
-					}
+			if (settings::moveFromPlayCursor &&
+					entry->flags & DF_MOVE_FROM_PLAY_CURSOR) {
+				if (GetPlayState() & 1) { // Playing
+					SetEditCurPos(GetPlayPosition(), false, false);
 				}
 			}
 			// #244: If the command was triggered via MIDI, pass the MIDI data when
 			// executing the command so that toggles, etc. work as expected.
 			KBD_OnMainActionEx(command, val, valHw, relMode, hwnd, nullptr);
-			postIt->second(command);
+			entry->postExecute(command);
 			lastCommand=command;
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
 		}
-		const auto mIt = POST_COMMAND_MESSAGES.find(command);
-		if (mIt != POST_COMMAND_MESSAGES.end()) {
+		if (entry->message) {
 			isHandlingCommand = true;
 			KBD_OnMainActionEx(command, val, valHw, relMode, hwnd, nullptr);
-			outputMessage(translate(mIt->second));
+			outputMessage(translate(entry->message));
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
 		}
-	}else if (section==MIDI_EDITOR_SECTION) {
-		const auto it = midiPostCommandsMap.find(command);
-		if (it != midiPostCommandsMap.end()) {
+	}else if (entry->section==MIDI_EDITOR_SECTION) {
+		if (entry->postExecute) {
 			isHandlingCommand = true;
 			HWND editor = MIDIEditor_GetActive();
 			MIDIEditor_OnCommand(editor, command);
-			it->second(command);
+			entry->postExecute(command);
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
 		}
-		const auto mIt = MIDI_POST_COMMAND_MESSAGES.find(command);
-		if (mIt != MIDI_POST_COMMAND_MESSAGES.end()) {
+		if (entry->message) {
 			isHandlingCommand = true;
 			HWND editor = MIDIEditor_GetActive();
 			MIDIEditor_OnCommand(editor, command);
-			outputMessage(translate(mIt->second));
+			outputMessage(translate(entry->message));
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
 		}
-	}else if (section==MIDI_EVENT_LIST_SECTION) {
-		const auto it = midiEventListPostCommandsMap.find(command);
-		if (it != midiEventListPostCommandsMap.end()) {
+	}else if (entry->section==MIDI_EVENT_LIST_SECTION) {
+		if (entry->postExecute) {
 			isHandlingCommand = true;
 			lastCommandTime = GetTickCount();
 			HWND editor = MIDIEditor_GetActive();
 			MIDIEditor_OnCommand(editor, command);
-			it->second.first(command);
+			entry->postExecute(command);
 			#ifdef _WIN32
-			if (it->second.second) { // changesValueInMidiEventList
+			if (entry->flags & DF_CHANGES_VALUE_IN_MIDI_EVENT_LIST) {
 				HWND focus = GetFocus();
 				if (focus && isMidiEditorEventListView(focus)) {
 					sendNameChangeEventToMidiEditorEventListItem(focus);
@@ -5465,12 +5907,11 @@ bool handlePostCommand(int section, int command, int val, int valHw,
 			isHandlingCommand = false;
 			return true;
 		}
-	} else if(section == MEDIA_EXPLORER_SECTION) {
-		const auto it = mExplorerPostCommands.find(command);
-		if(it != mExplorerPostCommands.end()){
+	} else if(entry->section == MEDIA_EXPLORER_SECTION) {
+		if(entry->mExplorerPostExecute){
 			isHandlingCommand = true;
 			SendMessage(hwnd, WM_COMMAND, command, 0);
-			it->second(command, hwnd);
+			entry->mExplorerPostExecute(command, hwnd);
 			lastCommandTime = GetTickCount();
 			isHandlingCommand = false;
 			return true;
@@ -5479,10 +5920,11 @@ bool handlePostCommand(int section, int command, int val, int valHw,
 	return false;
 }
 
-bool handleToggleCommand(KbdSectionInfo* section, int command, int val, int valHw, int relMode, HWND hwnd) {
-	const auto entry = TOGGLE_COMMAND_MESSAGES.find({section->uniqueID, command});
-	if (entry != TOGGLE_COMMAND_MESSAGES.end() && !entry->second.onMsg &&
-			!entry->second.offMsg) {
+bool handleToggleCommand(KbdSectionInfo* section, const DispatchEntry* entry,
+	int command, int val, int valHw, int relMode, HWND hwnd
+) {
+	const ToggleCommandMessage* toggle = entry ? entry->toggleMessage : nullptr;
+	if (toggle && !toggle->onMsg && !toggle->offMsg) {
 		return false; // Ignore.
 	}
 	int oldState = GetToggleCommandState2(section, command);
@@ -5512,8 +5954,8 @@ bool handleToggleCommand(KbdSectionInfo* section, int command, int val, int valH
 		isHandlingCommand = false;
 		return true; // No change, report nothing.
 	}
-	if (entry != TOGGLE_COMMAND_MESSAGES.end()) {
-		const char* message = newState ? entry->second.onMsg : entry->second.offMsg;
+	if (toggle) {
+		const char* message = newState ? toggle->onMsg : toggle->offMsg;
 		if (message) {
 			outputMessage(translate(message));
 		}
@@ -5542,23 +5984,35 @@ bool handleCommand(KbdSectionInfo* section, int command, int val, int valHw, int
 		// since we don't need to special case these alt sections everywhere.
 		section = SectionFromUniqueID(MAIN_SECTION);
 	}
-	const auto it = commandsMap.find(make_pair(section->uniqueID, command));
-	if (it != commandsMap.end()
+	perfTrace::ScopedTimer timer(perfTrace::SITE_COMMAND, section->uniqueID,
+		command);
+	const DispatchEntry* entry = dispatchTable.find(section->uniqueID, command);
+	if (entry) {
+		dispatchingEntry = entry;
+		dispatchStartTime = chrono::steady_clock::now();
+	}
+	// Whatever happens, stop measuring once we return.
+	auto stopMeasuring = [](bool result) {
+		dispatchingEntry = nullptr;
+		return result;
+	};
+	Command* osaraCommand = entry ? entry->osaraCommand : nullptr;
+	if (osaraCommand
 		// Allow shortcut help to be disabled.
-		&& (!isShortcutHelpEnabled || it->second->execute == cmdShortcutHelp)
+		&& (!isShortcutHelpEnabled || osaraCommand->execute == cmdShortcutHelp)
 	) {
 		isHandlingCommand = true;
-		if (it->second->gaccel.accel.cmd == lastCommand &&
+		if (osaraCommand->gaccel.accel.cmd == lastCommand &&
 				GetTickCount() - lastCommandTime < 500) {
 			++lastCommandRepeatCount;
 		} else {
 			lastCommandRepeatCount = 0;
 		}
-		it->second->execute(it->second);
-		lastCommand = it->second->gaccel.accel.cmd;
+		osaraCommand->execute(osaraCommand);
+		lastCommand = osaraCommand->gaccel.accel.cmd;
 		lastCommandTime = GetTickCount();
 		isHandlingCommand = false;
-		return true;
+		return stopMeasuring(true);
 	}
 	// Allow "Main action section: Momentarily set override" actions to pass
 	// through shortcut help so that users can learn about shortcuts in those
@@ -5568,19 +6022,19 @@ bool handleCommand(KbdSectionInfo* section, int command, int val, int valHw, int
 	if (isShortcutHelpEnabled &&
 			(command < ACTION_MOMENTARY_DEFAULT || command > ACTION_MOMENTARY_ALT16)) {
 		outputMessage(getActionName(command, section, false));
-		return true;
+		return stopMeasuring(true);
 	}
-	if (handlePostCommand(section->uniqueID, command, val, valHw, relMode,
-			hwnd)) {
-		return true;
+	if (handlePostCommand(entry, val, valHw, relMode, hwnd)) {
+		return stopMeasuring(true);
 	}
 	if (handleSettingCommand(command)) {
-		return true;
+		return stopMeasuring(true);
 	}
-	if (handleToggleCommand(section, command, val, valHw, relMode, hwnd)) {
-		return true;
+	if (handleToggleCommand(section, entry, command, val, valHw, relMode,
+			hwnd)) {
+		return stopMeasuring(true);
 	}
-	return false;
+	return stopMeasuring(false);
 }
 
 bool handleMainCommandFallback(int command, int flag) {
@@ -5590,6 +6044,63 @@ bool handleMainCommandFallback(int command, int flag) {
 
 IReaperControlSurface* surface = nullptr;
 
+// The entries used to build dispatchTable. Post commands and messages for
+// built-in commands are added when OSARA is loaded so that they work
+// immediately. OSARA's own commands and commands provided by other extensions
+// only get command ids in delayedInit(), so they are added then and the table
+// is rebuilt.
+map<pair<int, int>, DispatchEntry> dispatchEntries;
+
+DispatchEntry& dispatchEntryFor(int section, int command) {
+	DispatchEntry& entry = dispatchEntries[{section, command}];
+	entry.section = section;
+	entry.command = command;
+	return entry;
+}
+
+void buildBuiltinDispatchEntries() {
+	for (int i = 0; POST_COMMANDS[i].cmd; ++i) {
+		DispatchEntry& entry = dispatchEntryFor(MAIN_SECTION, POST_COMMANDS[i].cmd);
+		if (!entry.postExecute) {
+			entry.postExecute = POST_COMMANDS[i].execute;
+		}
+	}
+	for (const auto& [cmd, message] : POST_COMMAND_MESSAGES) {
+		dispatchEntryFor(MAIN_SECTION, cmd).message = message.c_str();
+	}
+	for (int cmd : MOVE_FROM_PLAY_CURSOR_COMMANDS) {
+		dispatchEntryFor(MAIN_SECTION, cmd).flags |= DF_MOVE_FROM_PLAY_CURSOR;
+	}
+	for (auto& midiPostCommand : MIDI_POST_COMMANDS) {
+		DispatchEntry& entry = dispatchEntryFor(MIDI_EDITOR_SECTION,
+			midiPostCommand.cmd);
+		if (!entry.postExecute) {
+			entry.postExecute = midiPostCommand.execute;
+		}
+		if (midiPostCommand.supportedInMidiEventList) {
+			DispatchEntry& listEntry = dispatchEntryFor(MIDI_EVENT_LIST_SECTION,
+				midiPostCommand.cmd);
+			if (!listEntry.postExecute) {
+				listEntry.postExecute = midiPostCommand.execute;
+				if (midiPostCommand.changesValueInMidiEventList) {
+					listEntry.flags |= DF_CHANGES_VALUE_IN_MIDI_EVENT_LIST;
+				}
+			}
+		}
+	}
+	for (const auto& [cmd, message] : MIDI_POST_COMMAND_MESSAGES) {
+		dispatchEntryFor(MIDI_EDITOR_SECTION, cmd).message = message.c_str();
+	}
+	for (const auto& [cmd, execute] : mExplorerPostCommands) {
+		dispatchEntryFor(MEDIA_EXPLORER_SECTION, cmd).mExplorerPostExecute =
+			execute;
+	}
+	for (const auto& [key, toggle] : TOGGLE_COMMAND_MESSAGES) {
+		dispatchEntryFor(key.first, key.second).toggleMessage = &toggle;
+	}
+	dispatchTable.build(dispatchEntries);
+}
+
 // Initialisation that must be done after REAPER_PLUGIN_ENTRYPOINT;
 // e.g. because it depends on stuff registered by other plug-ins.
 void delayedInit() {
@@ -5619,14 +6130,27 @@ void delayedInit() {
 			// This command is provided by an extension.
 			COMMANDS[i].gaccel.accel.cmd = NamedCommandLookup(COMMANDS[i].id);
 		}
-		commandsMap.insert(make_pair(make_pair(COMMANDS[i].section, COMMANDS[i].gaccel.accel.cmd), &COMMANDS[i]));
+		DispatchEntry& entry = dispatchEntryFor(COMMANDS[i].section,
+			COMMANDS[i].gaccel.accel.cmd);
+		// As with the map this replaced, the first command wins.
+		if (!entry.osaraCommand) {
+			entry.osaraCommand = &COMMANDS[i];
+		}
 	}
 
 	for (int i = 0; POST_CUSTOM_COMMANDS[i].id; ++i) {
 		int cmd = NamedCommandLookup(POST_CUSTOM_COMMANDS[i].id);
-		if (cmd)
-			postCommandsMap.insert(make_pair(cmd, POST_CUSTOM_COMMANDS[i].execute));
+		if (cmd) {
+			DispatchEntry& entry = dispatchEntryFor(MAIN_SECTION, cmd);
+			if (!entry.postExecute) {
+				entry.postExecute = POST_CUSTOM_COMMANDS[i].execute;
+			}
+		}
 	}
+	// Rebuild the table with the entries which need command ids from REAPER.
+	dispatchTable.build(dispatchEntries);
+	// Entries can't change after this.
+	dispatchEntries.clear();
 
 	maybeAutoConfigReaperOptimal();
 	startUpdateCheck();
@@ -5667,21 +6191,38 @@ void handleCustomMenu(const char* menuId, HMENU menu, int flag) {
 
 #ifdef _WIN32
 
-void annotateAccRole(HWND hwnd, long role) {
+// The roles we've set on windows. Dialogs are annotated every time they're
+// shown and the FX chain enumerates its child dialogs each time too, so this
+// avoids repeatedly calling into oleacc for the same window. Entries are
+// removed when the window is destroyed.
+unordered_map<HWND, long> annotatedRoles;
+
+// Returns false if the window already had this role annotated.
+bool annotateAccRole(HWND hwnd, long role) {
+	auto [it, inserted] = annotatedRoles.insert({hwnd, role});
+	if (!inserted) {
+		if (it->second == role) {
+			return false;
+		}
+		it->second = role;
+	}
 	VARIANT var;
 	var.vt = VT_I4;
 	var.lVal = role;
 	accPropServices->SetHwndProp(hwnd, OBJID_CLIENT, CHILDID_SELF, PROPID_ACC_ROLE,
 		var);
+	return true;
 }
 
 // Several windows in REAPER report as dialogs/property pages, but they aren't really.
 // This includes the main window.
 // Annotate these to prevent screen readers from potentially reading a spurious caption.
 void annotateSpuriousDialog(HWND hwnd) {
-	annotateAccRole(hwnd,
-		hwnd == mainHwnd || hwnd == GetForegroundWindow() ? ROLE_SYSTEM_CLIENT :
-		ROLE_SYSTEM_GROUPING);
+	if (!annotateAccRole(hwnd,
+			hwnd == mainHwnd || hwnd == GetForegroundWindow() ? ROLE_SYSTEM_CLIENT :
+			ROLE_SYSTEM_GROUPING)) {
+		return; // Already annotated.
+	}
 	// If the previous hwnd is static text, oleacc will use this as the name.
 	// This is never correct for these windows, so override it.
 	if (GetWindowTextLength(hwnd) == 0) {
@@ -5709,6 +6250,15 @@ DWORD prevForegroundTime = 0;
 HWND prevPrevForegroundHwnd = nullptr;
 
 void CALLBACK handleWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG objId, long childId, DWORD thread, DWORD time) {
+	perfTrace::ScopedTimer timer(perfTrace::SITE_WIN_EVENT, 0, (int)event);
+	if (event == EVENT_OBJECT_DESTROY) {
+		if (objId == OBJID_WINDOW && childId == CHILDID_SELF) {
+			// The handle might be reused for a different window.
+			windowKinds.erase(hwnd);
+			annotatedRoles.erase(hwnd);
+		}
+		return;
+	}
 	if (event == EVENT_OBJECT_FOCUS) {
 		HWND foreground = GetForegroundWindow();
 		if (foreground != prevForegroundHwnd) {
@@ -5794,7 +6344,12 @@ void CALLBACK handleWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG ob
 			maybeAnnotatePreferenceDescription();
 		}
 	} else if (event == EVENT_OBJECT_SHOW) {
-		if (isClassName(hwnd, "#32770")) {
+		if (objId != OBJID_WINDOW) {
+			return;
+		}
+		// Classify the window now so that later lookups (e.g. for every key press)
+		// are cheap.
+		if (getWindowKinds(hwnd) & WK_DIALOG) {
 			static CallLater fxLater;
 			fxLater.cancel();
 			if (GetFocusedFX(nullptr, nullptr, nullptr)) {
@@ -5807,7 +6362,16 @@ void CALLBACK handleWinEvent(HWINEVENTHOOK hook, DWORD event, HWND hwnd, LONG ob
 		}
 	}
 }
-HWINEVENTHOOK winEventHook = nullptr;
+// Each event we handle has its own hook. A single hook for a range of events
+// would also deliver events we don't care about (e.g. hide and reorder), which
+// can be very frequent when plugin UIs animate.
+const DWORD HANDLED_WIN_EVENTS[] = {
+	// Only needed to drop cached information about windows.
+	EVENT_OBJECT_DESTROY,
+	EVENT_OBJECT_SHOW,
+	EVENT_OBJECT_FOCUS,
+};
+HWINEVENTHOOK winEventHooks[size(HANDLED_WIN_EVENTS)] = {};
 
 #endif // _WIN32
 
@@ -5825,29 +6389,23 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(REAPER_PLUGIN_HINSTANCE hI
 		resetTimeCache();
 		initTranslation();
 		peakWatcher::initialize();
+		buildBuiltinDispatchEntries();
 
 #ifdef _WIN32
 		if (CoCreateInstance(CLSID_AccPropServices, nullptr, CLSCTX_SERVER, IID_IAccPropServices, (void**)&accPropServices) != S_OK) {
 			return 0;
 		}
 		guiThread = GetWindowThreadProcessId(mainHwnd, nullptr);
-		winEventHook = SetWinEventHook(EVENT_OBJECT_SHOW, EVENT_OBJECT_FOCUS,
-			hInstance, handleWinEvent, 0, guiThread, WINEVENT_INCONTEXT);
+		for (size_t h = 0; h < size(HANDLED_WIN_EVENTS); ++h) {
+			winEventHooks[h] = SetWinEventHook(HANDLED_WIN_EVENTS[h],
+				HANDLED_WIN_EVENTS[h], hInstance, handleWinEvent, 0, guiThread,
+				WINEVENT_INCONTEXT);
+		}
 		annotateSpuriousDialogs(mainHwnd);
 #else
 		NSA11yWrapper::init();
 #endif
 
-		for (int i = 0; POST_COMMANDS[i].cmd; ++i)
-			postCommandsMap.insert(make_pair(POST_COMMANDS[i].cmd, POST_COMMANDS[i].execute));
-
-		for (auto &midiPostCommand: MIDI_POST_COMMANDS) {
-			midiPostCommandsMap.insert(make_pair(midiPostCommand.cmd, midiPostCommand.execute));
-			if (midiPostCommand.supportedInMidiEventList) {
-				midiEventListPostCommandsMap.insert(make_pair(midiPostCommand.cmd, make_pair(midiPostCommand.execute, midiPostCommand.changesValueInMidiEventList)));
-			}
-		}
-
 		registerSettingCommands();
 		// hookcommand can only handle actions for the main section, so we need hookcommand2.
 		// According to SWS, hookcommand2 must be registered before hookcommand.
@@ -5871,7 +6429,11 @@ REAPER_PLUGIN_DLL_EXPORT int REAPER_PLUGIN_ENTRYPOINT(REAPER_PLUGIN_HINSTANCE hI
 		delete surface;
 #ifdef _WIN32
 		UnhookWindowsHookEx(keyboardHook);
-		UnhookWinEvent(winEventHook);
+		for (HWINEVENTHOOK hook : winEventHooks) {
+			if (hook) {
+				UnhookWinEvent(hook);
+			}
+		}
 		terminateUia();
 		accPropServices->Release();
 #else
@@ -28,6 +28,7 @@
 #define ID_PEAK_DISABLE 209
 #define ID_PEAK_CHAN1 210
 #define ID_PEAK_CHAN2 211
+#define ID_PEAK_INTERVAL 212
 
 #define ID_CONFIG_DLG 300
 
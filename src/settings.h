@@ -50,3 +50,9 @@ BoolSetting(reportNotes, MIDI_EDITOR_SECTION,
 BoolSetting(reportSurfaceChanges, MAIN_SECTION,
 	"Report changes made via &control surfaces",
 	false)
+BoolSetting(peakWatcherFromControlSurface, MAIN_SECTION,
+	"Sample Peak &Watcher during control surface updates instead of using a separate timer",
+	false)
+BoolSetting(perfTrace, MAIN_SECTION,
+	"Record perform&ance trace",
+	false)
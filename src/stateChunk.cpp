@@ -0,0 +1,115 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * State chunk scanner code
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <cstdlib>
+#include "stateChunk.h"
+
+using namespace std;
+
+bool ChunkScanner::next() {
+	if (!this->pos || !*this->pos) {
+		return false;
+	}
+	const char* start = this->pos;
+	while (*start == ' ' || *start == '\t') {
+		++start;
+	}
+	const char* end = start;
+	while (*end && *end != '\n') {
+		++end;
+	}
+	this->pos = *end ? end + 1 : end;
+	// Exclude a Windows line ending.
+	const char* lineEnd = end > start && end[-1] == '\r' ? end - 1 : end;
+	this->currentLine = string_view(start, lineEnd - start);
+	this->currentDepth = this->nextDepth;
+	if (!this->currentLine.empty()) {
+		if (this->currentLine[0] == '<') {
+			++this->nextDepth;
+		} else if (this->currentLine[0] == '>') {
+			--this->nextDepth;
+			this->currentDepth = this->nextDepth;
+		}
+	}
+	return true;
+}
+
+string_view ChunkScanner::word(int index) const {
+	string_view rest = this->currentLine;
+	for (;;) {
+		size_t start = rest.find_first_not_of(" \t");
+		if (start == string_view::npos) {
+			return {};
+		}
+		rest.remove_prefix(start);
+		size_t len;
+		char quote = rest[0];
+		if (quote == '"' || quote == '\'' || quote == '`') {
+			size_t close = rest.find(quote, 1);
+			len = close == string_view::npos ? rest.size() : close + 1;
+		} else {
+			len = rest.find_first_of(" \t");
+			if (len == string_view::npos) {
+				len = rest.size();
+			}
+		}
+		if (index == 0) {
+			return rest.substr(0, len);
+		}
+		--index;
+		rest.remove_prefix(len);
+	}
+}
+
+double ChunkScanner::number(int index) const {
+	string_view w = this->word(index);
+	if (w.empty()) {
+		return 0;
+	}
+	// The chunk is null terminated and the word is followed by white space or
+	// the end of the chunk, so strtod will stop at the end of the word.
+	return strtod(w.data(), nullptr);
+}
+
+bool ChunkScanner::findTag(string_view tag, bool withinBlock) {
+	const int depth = this->currentDepth;
+	while (this->next()) {
+		if (withinBlock && this->currentDepth < depth) {
+			return false;
+		}
+		if (this->tag() == tag) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ChunkScanner::findTake(string_view guid) {
+	// Take properties are directly inside the item block; i.e. depth 1.
+	while (this->next()) {
+		if (this->currentDepth == 1 && this->tag() == "GUID" &&
+				this->word(1) == guid) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ChunkScanner::findTagInTake(string_view tag) {
+	while (this->next()) {
+		if (this->currentDepth == 0) {
+			return false; // End of the item.
+		}
+		if (this->currentDepth == 1 && this->tag() == "TAKE") {
+			return false; // Start of the next take.
+		}
+		if (this->tag() == tag) {
+			return true;
+		}
+	}
+	return false;
+}
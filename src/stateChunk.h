@@ -0,0 +1,60 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * State chunk scanner header
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <string_view>
+
+// Scans the lines of a REAPER state chunk in a single forward pass without
+// copying it. This allows callers to stop as soon as they find what they
+// want, rather than searching the entire chunk with a regular expression.
+class ChunkScanner {
+	public:
+	explicit ChunkScanner(const char* chunk): pos(chunk) {}
+
+	// Move to the next line. Returns false if there are no more lines.
+	bool next();
+	// The current line without leading white space.
+	std::string_view line() const {
+		return this->currentLine;
+	}
+	// The first word of the current line; e.g. "<SOURCE" or "GUID".
+	std::string_view tag() const {
+		return this->word(0);
+	}
+	// The word at index on the current line, where 0 is the tag. Quoted strings
+	// are treated as a single word, including the quotes. Returns an empty
+	// string_view if there is no such word.
+	std::string_view word(int index) const;
+	// The word at index on the current line interpreted as a number, or 0 if
+	// there is no such word.
+	double number(int index) const;
+	// The number of blocks which contain the current line. The line which opens
+	// a block and the line which closes it are both outside the block.
+	int depth() const {
+		return this->currentDepth;
+	}
+
+	// Move to the next line with the given tag. If withinBlock is true, stop
+	// when the block containing the current line ends. Returns false if the tag
+	// wasn't found.
+	bool findTag(std::string_view tag, bool withinBlock = false);
+	// For an item chunk, move to the take with the given GUID. Returns false if
+	// the take wasn't found.
+	bool findTake(std::string_view guid);
+	// For an item chunk positioned within a take (e.g. after findTake), move to
+	// the next line with the given tag in that take. Returns false if the take
+	// ends before the tag is found.
+	bool findTagInTake(std::string_view tag);
+
+	private:
+	const char* pos;
+	std::string_view currentLine;
+	int currentDepth = 0;
+	// The depth of the line following the current line.
+	int nextDepth = 0;
+};
@@ -0,0 +1,88 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Project timeline snapshot code
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#include <algorithm>
+#include "timeline.h"
+
+using namespace std;
+
+void MarkerTimeline::update() {
+	ReaProject* project = EnumProjects(-1, nullptr, 0);
+	int stateCount = GetProjectStateChangeCount(project);
+	if (project == this->project && stateCount == this->stateCount) {
+		return;
+	}
+	this->project = project;
+	this->stateCount = stateCount;
+	this->rebuild();
+}
+
+void MarkerTimeline::rebuild() {
+	this->markers.clear();
+	this->regions.clear();
+	bool isRegion;
+	double start, end;
+	const char* name;
+	int number;
+	for (int i = 0; EnumProjectMarkers(i, &isRegion, &start, &end, &name,
+			&number); ++i) {
+		auto& entries = isRegion ? this->regions : this->markers;
+		entries.push_back({start, isRegion ? end : start, i, number,
+			name ? name : ""});
+	}
+	// REAPER enumerates markers in position order, but we don't rely on that.
+	auto byStart = [](const Entry& a, const Entry& b) {
+		return a.start < b.start;
+	};
+	stable_sort(this->markers.begin(), this->markers.end(), byStart);
+	stable_sort(this->regions.begin(), this->regions.end(), byStart);
+	vector<IntervalIndex<size_t>::Interval> intervals;
+	intervals.reserve(this->regions.size());
+	for (size_t r = 0; r < this->regions.size(); ++r) {
+		intervals.push_back({this->regions[r].start, this->regions[r].end, r});
+	}
+	this->regionIndex.build(move(intervals));
+	// Entries might have moved, so the cursor must be found again.
+	this->markerCursor = 0;
+	this->cursorPos = 0;
+	this->currentRegion = nullptr;
+}
+
+void MarkerTimeline::seek(double pos) {
+	auto startsAfter = [](double pos, const Entry& entry) {
+		return pos < entry.start;
+	};
+	if (pos < this->cursorPos) {
+		// We moved backward; e.g. looping or the user moved the play cursor.
+		this->markerCursor = upper_bound(this->markers.begin(),
+			this->markers.end(), pos, startsAfter) - this->markers.begin();
+	} else {
+		while (this->markerCursor < this->markers.size() &&
+				this->markers[this->markerCursor].start <= pos) {
+			++this->markerCursor;
+		}
+	}
+	this->cursorPos = pos;
+	// Regions are visited in order of start, so the last is the one which
+	// started most recently.
+	this->currentRegion = nullptr;
+	this->regionIndex.forEachContaining(pos, /* includeEnd */ false,
+		[this](const auto& interval) {
+			this->currentRegion = &this->regions[interval.value];
+		});
+}
+
+const MarkerTimeline::Entry* MarkerTimeline::getLastMarker() const {
+	if (this->markerCursor == 0) {
+		return nullptr;
+	}
+	return &this->markers[this->markerCursor - 1];
+}
+
+const MarkerTimeline::Entry* MarkerTimeline::getCurrentRegion() const {
+	return this->currentRegion;
+}
@@ -0,0 +1,149 @@
+/*
+ * OSARA: Open Source Accessibility for the REAPER Application
+ * Project timeline snapshot header
+ * Copyright 2024 James Teh
+ * License: GNU General Public License version 2.0
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+#include "osara.h"
+
+// A static index of intervals (e.g. regions or items) which efficiently finds
+// all intervals containing a position. Intervals are sorted by start and a
+// tree over them stores the furthest end in each subtree, so a query visits
+// only the subtrees which could contain a match; i.e. O(log n + k) for k
+// matches rather than checking every interval.
+template<typename Value>
+class IntervalIndex {
+	public:
+	struct Interval {
+		double start;
+		double end;
+		Value value;
+	};
+
+	void build(std::vector<Interval> intervals) {
+		std::stable_sort(intervals.begin(), intervals.end(),
+			[](const Interval& a, const Interval& b) { return a.start < b.start; });
+		this->intervals = std::move(intervals);
+		this->leaves = 1;
+		while (this->leaves < this->intervals.size()) {
+			this->leaves *= 2;
+		}
+		this->maxEnd.assign(this->leaves * 2,
+			std::numeric_limits<double>::lowest());
+		for (size_t i = 0; i < this->intervals.size(); ++i) {
+			this->maxEnd[this->leaves + i] = this->intervals[i].end;
+		}
+		for (size_t node = this->leaves - 1; node > 0; --node) {
+			this->maxEnd[node] = std::max(this->maxEnd[node * 2],
+				this->maxEnd[node * 2 + 1]);
+		}
+	}
+
+	size_t size() const {
+		return this->intervals.size();
+	}
+
+	// Call func(interval) for each interval containing pos, in order of start.
+	// If includeEnd is false, an interval which ends at pos doesn't contain it.
+	template<typename Func>
+	void forEachContaining(double pos, bool includeEnd, Func func) const {
+		// Only intervals starting at or before pos can contain it.
+		size_t limit = std::upper_bound(this->intervals.begin(),
+			this->intervals.end(), pos,
+			[](double pos, const Interval& interval) {
+				return pos < interval.start;
+			}) - this->intervals.begin();
+		if (limit > 0) {
+			this->visit(1, 0, this->leaves, limit, pos, includeEnd, func);
+		}
+	}
+
+	private:
+	template<typename Func>
+	void visit(size_t node, size_t low, size_t high, size_t limit, double pos,
+		bool includeEnd, Func& func
+	) const {
+		if (low >= limit) {
+			return;
+		}
+		double end = this->maxEnd[node];
+		if (includeEnd ? end < pos : end <= pos) {
+			return; // Nothing in this subtree reaches pos.
+		}
+		if (high - low == 1) {
+			func(this->intervals[low]);
+			return;
+		}
+		size_t middle = (low + high) / 2;
+		this->visit(node * 2, low, middle, limit, pos, includeEnd, func);
+		this->visit(node * 2 + 1, middle, high, limit, pos, includeEnd, func);
+	}
+
+	std::vector<Interval> intervals;
+	size_t leaves = 1;
+	// An implicit binary tree over intervals. maxEnd[1] is the root and the
+	// leaves start at maxEnd[leaves].
+	std::vector<double> maxEnd;
+};
+
+// A snapshot of the markers and regions in the current project.
+// Querying these via the REAPER API means searching or enumerating the whole
+// project, which is costly for projects with thousands of markers when done
+// many times a second (e.g. during playback). The snapshot is only rebuilt
+// when the project state change count changes or the project is switched.
+class MarkerTimeline {
+	public:
+	struct Entry {
+		double start;
+		// For markers, this is the same as start.
+		double end;
+		// The index which can be passed to EnumProjectMarkers.
+		int index;
+		int number;
+		std::string name;
+	};
+
+	// Rebuild the snapshot if the project has changed since it was last built.
+	void update();
+
+	// Move the playback cursor to pos. When pos only moves forward, as it does
+	// during playback, this only steps over the markers passed since the last
+	// call. It falls back to a binary search if pos moves backward.
+	void seek(double pos);
+	// The last marker at or before the position passed to seek(), or nullptr.
+	const Entry* getLastMarker() const;
+	// The region containing the position passed to seek(), or nullptr. If
+	// regions overlap, this is the one which started most recently.
+	const Entry* getCurrentRegion() const;
+	// Call func(entry) for each region containing pos (including regions which
+	// end at pos), in order of start.
+	template<typename Func>
+	void forEachRegionAt(double pos, Func func) const {
+		this->regionIndex.forEachContaining(pos, /* includeEnd */ true,
+			[this, &func](const auto& interval) {
+				func(this->regions[interval.value]);
+			});
+	}
+
+	private:
+	void rebuild();
+
+	ReaProject* project = nullptr;
+	int stateCount = 0;
+	// Both sorted by start position.
+	std::vector<Entry> markers;
+	std::vector<Entry> regions;
+	// Maps to indexes in regions.
+	IntervalIndex<size_t> regionIndex;
+	double cursorPos = 0;
+	// The number of markers which start at or before cursorPos.
+	size_t markerCursor = 0;
+	const Entry* currentRegion = nullptr;
+};
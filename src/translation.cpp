@@ -6,11 +6,19 @@
  */
 
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <map>
 #include <tinygettext/dictionary.hpp>
+#include <tinygettext/plural_forms.hpp>
 #include <tinygettext/po_parser.hpp>
 #include "osara.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 #include <WDL/win32_utf8.h>
 #include "translation.h"
 
@@ -30,7 +38,223 @@ map<string, string> REAPER_LANG_TO_CODE = {
 	{"Turkish", "tr_TR"},
 };
 
+// The catalog format is documented in site_scons/makeCatalog.py.
+const char CATALOG_MAGIC[] = "OSRC";
+const uint32_t CATALOG_VERSION = 1;
+const size_t CATALOG_HEADER_SIZE = 20;
+const size_t CATALOG_ENTRY_FIELDS = 5;
+enum {
+	ENTRY_HASH,
+	ENTRY_KEY_OFFSET,
+	ENTRY_KEY_LENGTH,
+	ENTRY_VALUE_OFFSET,
+	ENTRY_VALUE_LENGTH,
+};
+
+TranslationCatalog translationCatalog;
 tinygettext::Dictionary translationDict;
+int translationGeneration = 0;
+tinygettext::PluralForms catalogPluralForms;
+
+// 32 bit FNV-1a. This must match hashKey in site_scons/makeCatalog.py.
+uint32_t hashCatalogKey(string_view context, string_view msg) {
+	uint32_t hash = 2166136261u;
+	auto add = [&hash](string_view s) {
+		for (unsigned char c: s) {
+			hash = (hash ^ c) * 16777619u;
+		}
+	};
+	if (!context.empty()) {
+		add(context);
+		add("\x04");
+	}
+	add(msg);
+	return hash;
+}
+
+// Map a file into memory for the life of the process.
+const char* mapFile(const string& path, size_t& size) {
+#ifdef _WIN32
+	HANDLE file = CreateFileW(widen(path).c_str(), GENERIC_READ,
+		FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		return nullptr;
+	}
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return nullptr;
+	}
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0,
+		nullptr);
+	// The mapping keeps the file open, so we don't need the file handle.
+	CloseHandle(file);
+	if (!mapping) {
+		return nullptr;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	// The view keeps the mapping alive.
+	CloseHandle(mapping);
+	size = (size_t)fileSize.QuadPart;
+	return (const char*)view;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		return nullptr;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+	void* view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED) {
+		return nullptr;
+	}
+	size = (size_t)info.st_size;
+	return (const char*)view;
+#endif
+}
+
+// Get the modification time of a file in seconds, or -1 if it doesn't exist.
+int64_t getFileModifiedTime(const string& path) {
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExW(widen(path).c_str(), GetFileExInfoStandard,
+			&info)) {
+		return -1;
+	}
+	ULARGE_INTEGER time;
+	time.LowPart = info.ftLastWriteTime.dwLowDateTime;
+	time.HighPart = info.ftLastWriteTime.dwHighDateTime;
+	// FILETIME is in 100 ns units.
+	return (int64_t)(time.QuadPart / 10000000);
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		return -1;
+	}
+	return (int64_t)info.st_mtime;
+#endif
+}
+
+bool TranslationCatalog::load(const string& path) {
+	size_t size = 0;
+	const char* data = mapFile(path, size);
+	if (!data) {
+		return false;
+	}
+	auto fail = [&] {
+#ifdef _WIN32
+		UnmapViewOfFile(data);
+#else
+		munmap((void*)data, size);
+#endif
+		return false;
+	};
+	// The catalog is generated by our build, but it's still loaded from disk, so
+	// validate it up front rather than on every lookup.
+	auto header = (const uint32_t*)data;
+	if (size < CATALOG_HEADER_SIZE ||
+			memcmp(data, CATALOG_MAGIC, 4) != 0 || header[1] != CATALOG_VERSION) {
+		return fail();
+	}
+	const uint32_t count = header[2];
+	const uint32_t bucketCount = header[3];
+	const uint32_t pluralFormsOffset = header[4];
+	// bucketCount must be a power of 2 and leave room for empty buckets so
+	// probing terminates.
+	if (bucketCount == 0 || (bucketCount & (bucketCount - 1)) != 0 ||
+			count >= bucketCount) {
+		return fail();
+	}
+	const size_t entriesOffset = CATALOG_HEADER_SIZE + bucketCount * 4;
+	const size_t stringsOffset = entriesOffset +
+		count * CATALOG_ENTRY_FIELDS * 4;
+	if (stringsOffset > size || pluralFormsOffset >= size) {
+		return fail();
+	}
+	auto buckets = (const uint32_t*)(data + CATALOG_HEADER_SIZE);
+	for (uint32_t b = 0; b < bucketCount; ++b) {
+		if (buckets[b] > count) {
+			return fail();
+		}
+	}
+	auto entries = (const uint32_t*)(data + entriesOffset);
+	for (uint32_t e = 0; e < count; ++e) {
+		const uint32_t* entry = entries + e * CATALOG_ENTRY_FIELDS;
+		// Every string must be followed by a null terminator within the file.
+		if ((size_t)entry[ENTRY_KEY_OFFSET] + entry[ENTRY_KEY_LENGTH] >= size ||
+				(size_t)entry[ENTRY_VALUE_OFFSET] + entry[ENTRY_VALUE_LENGTH] >=
+				size) {
+			return fail();
+		}
+	}
+	const char* pluralForms = data + pluralFormsOffset;
+	if (!memchr(pluralForms, '\0', size - pluralFormsOffset)) {
+		return fail();
+	}
+	catalogPluralForms = tinygettext::PluralForms::from_string(pluralForms);
+	this->data = data;
+	this->size = size;
+	this->bucketCount = bucketCount;
+	this->buckets = buckets;
+	this->entries = entries;
+	return true;
+}
+
+const char* TranslationCatalog::find(string_view context, string_view msg
+) const {
+	const uint32_t hash = hashCatalogKey(context, msg);
+	const size_t keyLength = context.empty() ? msg.size() :
+		context.size() + 1 + msg.size();
+	for (uint32_t b = hash & (this->bucketCount - 1); this->buckets[b];
+			b = (b + 1) & (this->bucketCount - 1)) {
+		const uint32_t* entry = this->entries +
+			(this->buckets[b] - 1) * CATALOG_ENTRY_FIELDS;
+		if (entry[ENTRY_HASH] != hash || entry[ENTRY_KEY_LENGTH] != keyLength) {
+			continue;
+		}
+		const char* key = this->data + entry[ENTRY_KEY_OFFSET];
+		if (!context.empty()) {
+			if (context.compare(0, context.size(), key, context.size()) != 0 ||
+					key[context.size()] != '\x04') {
+				continue;
+			}
+			key += context.size() + 1;
+		}
+		if (msg.compare(0, msg.size(), key, msg.size()) == 0) {
+			return this->data + entry[ENTRY_VALUE_OFFSET];
+		}
+	}
+	return nullptr;
+}
+
+unsigned int TranslationCatalog::getPluralForm(int num) const {
+	if (catalogPluralForms) {
+		return catalogPluralForms.getPlural(num);
+	}
+	// The catalog didn't specify a plural expression we know. Assume the English
+	// rules.
+	return num == 1 ? 0 : 1;
+}
+
+const char* TranslationCatalog::selectPlural(const char* forms, int num
+) const {
+	unsigned int form = this->getPluralForm(num);
+	// Forms are terminated by an empty form. If the catalog doesn't have the
+	// requested form, use the last one we have.
+	const char* selected = forms;
+	for (unsigned int f = 0; f < form; ++f) {
+		const char* next = selected + strlen(selected) + 1;
+		if (!*next) {
+			break;
+		}
+		selected = next;
+	}
+	return selected;
+}
 
 void initTranslation() {
 	// Figure out which file name to load. We base it on the REAPER language
@@ -55,12 +279,23 @@ void initTranslation() {
 	if (nameIt != REAPER_LANG_TO_CODE.end()) {
 		name = nameIt->second;
 	}
-	name += ".po";
 	// OSARA translations are stored in osara/locale in the REAPER resource
 	// directory.
 	string path(GetResourcePath());
 	path += "/osara/locale/";
 	path += name;
+	// Prefer the compiled catalog, since it loads much faster. However, if the
+	// po file is newer, it has been updated (e.g. by a translator) since the
+	// catalog was built, so the catalog is out of date and the po file is used
+	// instead.
+	const string catalogPath = path + ".osaracat";
+	path += ".po";
+	const int64_t catalogTime = getFileModifiedTime(catalogPath);
+	if (catalogTime != -1 && catalogTime >= getFileModifiedTime(path) &&
+			translationCatalog.load(catalogPath)) {
+		++translationGeneration;
+		return;
+	}
 #ifdef _WIN32
 	// REAPER provides UTF-8 strings. However, on Windows, ifstream will
 	// interpret a narrow (8 bit) string as an ANSI string. The easiest way to
@@ -71,6 +306,7 @@ void initTranslation() {
 	ifstream input(path);
 #endif
 	tinygettext::POParser::parse(path, input, translationDict);
+	++translationGeneration;
 }
 
 BOOL CALLBACK translateWindow(HWND hwnd, LPARAM lParam) {
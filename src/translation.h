@@ -7,26 +7,76 @@
 
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <tinygettext/dictionary.hpp>
 #include <fmt/core.h>
 #include <fmt/format.h>
 
+// A compiled translation catalog (see site_scons/makeCatalog.py) mapped into
+// memory. If there is no catalog for the current language, we fall back to
+// parsing the po file into translationDict.
+class TranslationCatalog {
+	public:
+	bool load(const std::string& path);
+	bool isLoaded() const {
+		return !!this->data;
+	}
+	// Returns the translation or nullptr if there is none. For plurals, this is
+	// the first form. Other forms follow, each after the previous form's null
+	// terminator.
+	const char* find(std::string_view context, std::string_view msg) const;
+	// Returns the index of the plural form to use for num.
+	unsigned int getPluralForm(int num) const;
+	// Given the result of find() for a plural message, return the form for num.
+	const char* selectPlural(const char* forms, int num) const;
+
+	private:
+	const char* data = nullptr;
+	size_t size = 0;
+	unsigned int bucketCount = 0;
+	const uint32_t* buckets = nullptr;
+	const uint32_t* entries = nullptr;
+};
+
+extern TranslationCatalog translationCatalog;
 extern tinygettext::Dictionary translationDict;
+// Incremented whenever translations are (re)loaded. See CachedTranslation.
+extern int translationGeneration;
 
 void initTranslation();
 void translateDialog(HWND dialog);
 
 template<typename S>
 auto translate(S msg) {
+	if (translationCatalog.isLoaded()) {
+		if (const char* translated = translationCatalog.find({}, msg)) {
+			return decltype(translationDict.translate(msg))(translated);
+		}
+	}
 	return translationDict.translate(msg);
 }
 template<typename S>
 auto translate_ctxt(S context, S msg) {
+	if (translationCatalog.isLoaded()) {
+		if (const char* translated = translationCatalog.find(context, msg)) {
+			return decltype(translationDict.translate_ctxt(context, msg))(
+				translated);
+		}
+	}
 	return translationDict.translate_ctxt(context, msg);
 }
 template<typename S, typename N>
 auto translate_plural(S msg, S msgPlural, N num) {
+	if (translationCatalog.isLoaded()) {
+		if (const char* forms = translationCatalog.find({}, msg)) {
+			return decltype(translationDict.translate_plural(msg, msgPlural, num))(
+				translationCatalog.selectPlural(forms, (int)num));
+		}
+	}
 	return translationDict.translate_plural(msg, msgPlural, num);
 }
 
@@ -35,6 +85,145 @@ auto translate_plural(S msg, S msgPlural, N num) {
 constexpr auto _t(auto msg) {
 	return msg;
 }
+// Like _t, but for a message with a plural form.
+constexpr auto _tn(auto msg, auto msgPlural) {
+	return std::pair(msg, msgPlural);
+}
+
+// A message which is only looked up once, rather than hashing the message
+// every time it is translated. This is intended for messages used in hot paths;
+// e.g. while the play cursor moves. Instances should be static and
+// initialised with _t() or _tn() so the message is extracted for translation.
+class CachedTranslation {
+	public:
+	constexpr CachedTranslation(const char* msg): msg(msg) {}
+	constexpr CachedTranslation(std::pair<const char*, const char*> msgs):
+		msg(msgs.first), msgPlural(msgs.second) {}
+
+	const char* get() const {
+		this->update();
+		return this->translated;
+	}
+	const char* get(int num) const {
+		this->update();
+		if (this->isPluralFromCatalog) {
+			return translationCatalog.selectPlural(this->translated, num);
+		}
+		// The po fallback can't give us all the forms, so look it up each time.
+		return translationDict.translate_plural(this->msg, this->msgPlural, num);
+	}
+
+	private:
+	void update() const {
+		if (this->generation == translationGeneration) {
+			return;
+		}
+		this->generation = translationGeneration;
+		this->isPluralFromCatalog = false;
+		if (this->msgPlural) {
+			if (translationCatalog.isLoaded()) {
+				this->translated = translationCatalog.find({}, this->msg);
+				this->isPluralFromCatalog = !!this->translated;
+			}
+			return;
+		}
+		this->translated = translate(this->msg);
+	}
+
+	const char* msg;
+	const char* msgPlural = nullptr;
+	mutable const char* translated = nullptr;
+	mutable bool isPluralFromCatalog = false;
+	mutable int generation = -1;
+};
+
+// A translated format string which is looked up and validated once per
+// language load rather than on every call. Formatting appends to a buffer so
+// that a message can be built from several parts without any intermediate
+// strings. As with CachedTranslation, instances should be static and
+// initialised with _t() or _tn().
+class CachedFormat {
+	public:
+	constexpr CachedFormat(const char* msg): translation(msg) {}
+	constexpr CachedFormat(std::pair<const char*, const char*> msgs):
+		translation(msgs) {}
+
+	template<typename... Args>
+	void formatTo(fmt::memory_buffer& out, const Args&... args) const {
+		this->formatPatternTo(out, this->translation.get(), args...);
+	}
+	// For a plural message, num selects the plural form.
+	template<typename... Args>
+	void formatPluralTo(fmt::memory_buffer& out, int num, const Args&... args
+	) const {
+		this->formatPatternTo(out, this->translation.get(num), args...);
+	}
+
+	private:
+	template<typename... Args>
+	void formatPatternTo(fmt::memory_buffer& out, const char* pattern,
+		const Args&... args
+	) const {
+		if (this->generation != translationGeneration) {
+			this->generation = translationGeneration;
+			this->patternCount = 0;
+		}
+		// Each plural form is a separate pattern.
+		Pattern* cached = nullptr;
+		for (int p = 0; p < this->patternCount; ++p) {
+			if (this->patterns[p].text == pattern) {
+				cached = &this->patterns[p];
+				break;
+			}
+		}
+		if (!cached) {
+			Pattern checked{pattern, strlen(pattern), true};
+			// The argument types at a call site never change, so if formatting
+			// succeeds once, it always will.
+			const size_t oldSize = out.size();
+			try {
+				fmt::vformat_to(fmt::appender(out),
+					fmt::string_view(checked.text, checked.length),
+					fmt::make_format_args(args...));
+			} catch (fmt::format_error) {
+				out.resize(oldSize);
+				checked.isValid = false;
+			}
+			if (this->patternCount < MAX_PATTERNS) {
+				this->patterns[this->patternCount++] = checked;
+			}
+			if (!checked.isValid) {
+				formatErrorTo(out, pattern);
+			}
+			return;
+		}
+		if (!cached->isValid) {
+			formatErrorTo(out, pattern);
+			return;
+		}
+		fmt::vformat_to(fmt::appender(out),
+			fmt::string_view(cached->text, cached->length),
+			fmt::make_format_args(args...));
+	}
+
+	// Fail gracefully, as format() does.
+	static void formatErrorTo(fmt::memory_buffer& out, const char* pattern) {
+		fmt::format_to(fmt::appender(out), "error in format string: {}", pattern);
+	}
+
+	struct Pattern {
+		const char* text;
+		size_t length;
+		bool isValid;
+	};
+	// No language has more than 6 plural forms.
+	static constexpr int MAX_PATTERNS = 6;
+
+	CachedTranslation translation;
+	mutable Pattern patterns[MAX_PATTERNS] = {};
+	mutable int patternCount = 0;
+	mutable int generation = -1;
+};
 
 // Catch exceptions from fmt::format due to errors in translations so we can
 // fail gracefully instead of crashing.
@@ -9,7 +9,11 @@
 #include <ole2.h>
 #include <tlhelp32.h>
 #include <atlcomcli.h>
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <utility>
 #include "osara.h"
 #include "config.h"
@@ -67,7 +71,7 @@ class UiaProvider : public IRawElementProviderSimple {
 	HRESULT STDMETHODCALLTYPE QueryInterface(_In_ REFIID riid,
 		_Outptr_ void** ppInterface
 	) final {
-		if (ppInterface) {
+		if (!ppInterface) {
 			return E_INVALIDARG;
 		}
 		if (riid == __uuidof(IUnknown)) {
@@ -137,6 +141,177 @@ class UiaProvider : public IRawElementProviderSimple {
 };
 
 CComPtr<IRawElementProviderSimple> uiaProvider;
+// Posted to uiaWnd when the notifier fails to raise a notification so that the
+// message can be output by another method on the UI thread.
+const UINT WM_UIA_NOTIFICATION_FAILED = WM_APP;
+
+// Raising a notification is a cross-process call which can take a while if a
+// screen reader is slow to handle it. To avoid stalling REAPER's UI thread,
+// notifications are queued and raised on a separate thread.
+class UiaNotifier {
+	public:
+	void start() {
+		this->stopping = false;
+		this->failed = false;
+		// The provider uses COM threading and lives in the UI thread's apartment,
+		// so the worker must use it via a proxy.
+		IStream* stream = nullptr;
+		if (FAILED(CoMarshalInterThreadInterfaceInStream(
+				__uuidof(IRawElementProviderSimple), uiaProvider, &stream))) {
+			this->failed = true;
+			return;
+		}
+		this->worker = thread(&UiaNotifier::run, this, stream);
+	}
+
+	void stop() {
+		if (!this->worker.joinable()) {
+			return;
+		}
+		{
+			lock_guard lock(this->queueLock);
+			this->stopping = true;
+		}
+		this->wake.notify_one();
+		// The worker might be waiting for a call to the provider on this thread,
+		// so service COM calls while waiting for it to exit.
+		HANDLE handle = this->worker.native_handle();
+		DWORD index;
+		CoWaitForMultipleHandles(COWAIT_DEFAULT, INFINITE, 1, &handle, &index);
+		this->worker.join();
+	}
+
+	// Take the message which failed to be raised, if any. UI thread only.
+	bool takeFailedNotification(string& message, bool& interrupt) {
+		lock_guard lock(this->queueLock);
+		if (!this->hasFailedNotification) {
+			return false;
+		}
+		this->hasFailedNotification = false;
+		message = std::move(this->failedNotification.message);
+		interrupt = this->failedNotification.interrupt;
+		return true;
+	}
+
+	// Returns false if notifications aren't working, in which case the caller
+	// should fall back to another method.
+	bool queue(const string& message, bool interrupt) {
+		if (this->failed) {
+			return false;
+		}
+		if (message.empty()) {
+			return true;
+		}
+		{
+			lock_guard lock(this->queueLock);
+			if (interrupt) {
+				// Anything not yet raised would be interrupted by this anyway.
+				this->count = 0;
+			} else if (this->count == CAPACITY) {
+				// Drop the oldest message rather than blocking.
+				this->head = (this->head + 1) % CAPACITY;
+				--this->count;
+			}
+			Notification& notification =
+				this->notifications[(this->head + this->count) % CAPACITY];
+			notification.message = message;
+			notification.interrupt = interrupt;
+			++this->count;
+		}
+		this->wake.notify_one();
+		return true;
+	}
+
+	private:
+	void run(IStream* stream) {
+		CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+		CComPtr<IRawElementProviderSimple> provider;
+		if (FAILED(CoGetInterfaceAndReleaseStream(stream,
+				__uuidof(IRawElementProviderSimple), (void**)&provider))) {
+			this->failed = true;
+			CoUninitialize();
+			return;
+		}
+		// This never changes, so allocate it once.
+		BSTR activityId = SysAllocString(L"REAPER_OSARA");
+		DWORD lastListeningCheck = 0;
+		bool listening = false;
+		for (;;) {
+			Notification notification;
+			{
+				unique_lock lock(this->queueLock);
+				this->wake.wait(lock, [this] {
+					return this->stopping || this->count > 0;
+				});
+				if (this->stopping) {
+					break;
+				}
+				notification = std::move(this->notifications[this->head]);
+				this->head = (this->head + 1) % CAPACITY;
+				--this->count;
+			}
+			// UiaClientsAreListening is also a cross-process call, so we don't
+			// check it for every message when messages arrive in quick succession.
+			const DWORD now = GetTickCount();
+			if (lastListeningCheck == 0 ||
+					now - lastListeningCheck > LISTENING_CHECK_INTERVAL) {
+				listening = UiaClientsAreListening();
+				lastListeningCheck = now;
+			}
+			if (!listening) {
+				continue;
+			}
+			BSTR text = SysAllocString(widen(notification.message).c_str());
+			HRESULT hr = uiaCore->RaiseNotificationEvent(
+				provider,
+				NotificationKind_Other,
+				notification.interrupt ? NotificationProcessing_MostRecent :
+					NotificationProcessing_All,
+				text,
+				activityId
+			);
+			SysFreeString(text);
+			if (hr != S_OK) {
+				// Don't try again. Hand this message back to the UI thread so it
+				// isn't lost. Anything still queued is dropped, since the UI thread
+				// falls back for new messages from now on anyway.
+				this->failed = true;
+				{
+					lock_guard lock(this->queueLock);
+					this->failedNotification = std::move(notification);
+					this->hasFailedNotification = true;
+					this->count = 0;
+				}
+				PostMessage(uiaWnd, WM_UIA_NOTIFICATION_FAILED, 0, 0);
+				break;
+			}
+		}
+		SysFreeString(activityId);
+		// Release the proxy before leaving the apartment.
+		provider = nullptr;
+		CoUninitialize();
+	}
+
+	struct Notification {
+		string message;
+		bool interrupt;
+	};
+	static constexpr size_t CAPACITY = 32;
+	static constexpr DWORD LISTENING_CHECK_INTERVAL = 500;
+
+	Notification notifications[CAPACITY];
+	size_t head = 0;
+	size_t count = 0;
+	mutex queueLock;
+	condition_variable wake;
+	bool stopping = false;
+	atomic<bool> failed = false;
+	Notification failedNotification;
+	bool hasFailedNotification = false;
+	thread worker;
+};
+
+UiaNotifier uiaNotifier;
 
 LRESULT CALLBACK uiaWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 	switch (msg) {
@@ -145,6 +320,15 @@ LRESULT CALLBACK uiaWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
 				return UiaReturnRawElementProvider(hwnd, wParam, lParam, uiaProvider);
 			}
 			return 0;
+		case WM_UIA_NOTIFICATION_FAILED: {
+			string message;
+			bool interrupt;
+			if (uiaNotifier.takeFailedNotification(message, interrupt)) {
+				// Notifications have failed, so this falls back to another method.
+				_outputMessage(message, interrupt);
+			}
+			return 0;
+		}
 		default:
 			return DefWindowProc(hwnd, msg, wParam, lParam);
 	}
@@ -199,6 +383,7 @@ bool initializeUia() {
 	// Constructor  initializes refcount to 0, assignment to a CComPtr
 	// takes it to 1.
 	uiaProvider = new UiaProvider(uiaWnd);
+	uiaNotifier.start();
 	return true;
 }
 
@@ -207,6 +392,8 @@ bool hasTriedToInitializeUia() {
 }
 
 bool terminateUia() {
+	// The notifier uses the provider, so it must stop first.
+	uiaNotifier.stop();
 	if (uiaProvider) {
 		// Null out uiaProvider so it can't be returned by WM_GETOBJECT during
 		// disconnection.
@@ -253,16 +440,7 @@ bool shouldUseUiaNotifications() {
 }
 
 bool sendUiaNotification(const string& message, bool interrupt) {
-	if (!UiaClientsAreListening() || message.empty()) {
-		return true;
-	}
-	return (uiaCore->RaiseNotificationEvent(
-		uiaProvider,
-		NotificationKind_Other,
-		interrupt ? NotificationProcessing_MostRecent : NotificationProcessing_All,
-		SysAllocString(widen(message).c_str()),
-		SysAllocString(L"REAPER_OSARA")
-	) == S_OK);
+	return uiaNotifier.queue(message, interrupt);
 }
 
 void resetUia() {
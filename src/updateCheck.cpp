@@ -5,9 +5,14 @@
  * License: GNU General Public License version 2.0
  */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <ctime>
 #include <string>
 #include <sstream>
+#include <thread>
+#include <vector>
 // simpleson uses sscanf. We don't have any control over that.
 #pragma clang diagnostic push
 # pragma clang diagnostic ignored "-Wdeprecated-declarations"
@@ -30,13 +35,44 @@
 
 const char UPDATE_URL[] = "http://osara.reaperaccessibility.com/snapshots/update.json";
 const char DOWNLOAD_URL[] = "https://osara.reaperaccessibility.com/snapshots/";
+// ExtState keys for the HTTP cache validators from the last check which found
+// no update, along with the OSARA version they apply to.
+const char VALIDATOR_VERSION_KEY[] = "updateCheckVersion";
+const char ETAG_KEY[] = "updateCheckEtag";
+const char LAST_MODIFIED_KEY[] = "updateCheckLastModified";
+// ExtState key for the number of seconds after startup before an automatic
+// update check begins.
+const char DELAY_KEY[] = "updateCheckDelay";
+constexpr int DEFAULT_DELAY_SECS = 60;
+constexpr int MAX_DELAY_SECS = 60 * 60;
+const char LAST_CHECK_KEY[] = "lastUpdateCheck";
+
+// The outcome of the network request, produced by the worker thread.
+struct UpdateResult {
+	enum {
+		ERROR_,
+		// The server said update.json hasn't changed since the last check which
+		// found no update.
+		NOT_MODIFIED,
+		CURRENT,
+		AVAILABLE,
+	} status = ERROR_;
+	std::string version;
+	// Messages for commits newer than the running one, newest first.
+	std::vector<std::string> changes;
+	std::string etag;
+	std::string lastModified;
+};
 
 class UpdateChecker {
 	private:
-	UpdateChecker(bool manual);
+	UpdateChecker(bool manual, UINT delay);
 	~UpdateChecker();
+	void startWorker();
 	void tick();
 	void error();
+	static UpdateResult fetch(std::string etag, std::string lastModified,
+		const std::atomic<bool>& cancelled);
 
 	void killTimer() {
 		if (this->timer) {
@@ -46,15 +82,27 @@ class UpdateChecker {
 	}
 
 	static void CALLBACK timerCb(HWND hwnd, UINT msg, UINT_PTR event, DWORD time) {
-		UpdateChecker::instance->tick();
+		UpdateChecker* self = UpdateChecker::instance;
+		if (!self->worker.joinable()) {
+			// The startup delay has elapsed.
+			self->startWorker();
+			return;
+		}
+		self->tick();
 	}
 
 	static INT_PTR CALLBACK dialogProc(HWND dialog, UINT msg,
 		WPARAM wParam, LPARAM lParam);
 
 	bool manual;
-	JNL_HTTPGet connection;
 	UINT_PTR timer = 0;
+	// The network request and parsing are done on this thread so that they
+	// never hold up REAPER's UI.
+	std::thread worker;
+	std::atomic<bool> isDone = false;
+	std::atomic<bool> cancelled = false;
+	// Only accessed by the worker until isDone is set.
+	UpdateResult result;
 	// The singleton instance.
 	static UpdateChecker* instance;
 
@@ -65,16 +113,24 @@ class UpdateChecker {
 UpdateChecker* UpdateChecker::instance = nullptr;
 
 void startUpdateCheck(bool manual) {
-	if (UpdateChecker::instance) {
+	if (UpdateChecker* checker = UpdateChecker::instance) {
 		// An update check is already running.
+		if (manual) {
+			// The user asked for this check, so they should get feedback. If the
+			// automatic check is still waiting for the startup delay, don't make
+			// them wait.
+			checker->manual = true;
+			if (!checker->worker.joinable()) {
+				checker->startWorker();
+			}
+		}
 		return;
 	}
 	if (std::string(OSARA_VERSION).find(",") == std::string::npos) {
 		// No commit in the version string. This is a local build.
 		return;
 	}
-	auto curTime = time(nullptr);
-	const char LAST_CHECK_KEY[] = "lastUpdateCheck";
+	UINT delay = 0;
 	if (!manual) {
 		// If REAPER update checks are disabled, disable ours too.
 		char verCheck[2];
@@ -87,73 +143,124 @@ void startUpdateCheck(bool manual) {
 		const char* lastCheckStr = GetExtState(CONFIG_SECTION, LAST_CHECK_KEY);
 		uint64_t lastCheck = atoll(lastCheckStr);
 		constexpr uint64_t ONE_DAY = 24 * 60 * 60;
-		if (lastCheck + ONE_DAY > curTime) {
+		if (lastCheck + ONE_DAY > (uint64_t)time(nullptr)) {
 			return;
 		}
+		// Don't compete with REAPER and the user while a session is starting.
+		const char* delayStr = GetExtState(CONFIG_SECTION, DELAY_KEY);
+		int delaySecs = delayStr[0] ? atoi(delayStr) : DEFAULT_DELAY_SECS;
+		delay = (UINT)std::clamp(delaySecs, 0, MAX_DELAY_SECS) * 1000;
 	}
-	// Keep track of the last time we checked for an update. We do this even for
-	// a manual check because the user probably doesn't want auto update checks
-	// soon if they've just done a manual check.
-	SetExtState(CONFIG_SECTION, LAST_CHECK_KEY, format("{}", curTime).c_str(),
-		true);
-	UpdateChecker::instance = new UpdateChecker(manual);
+	UpdateChecker::instance = new UpdateChecker(manual, delay);
 }
 
 void cancelUpdateCheck() {
 	delete UpdateChecker::instance;
 }
 
-UpdateChecker::UpdateChecker(bool manual): manual(manual) {
-	JNL::open_socketlib();
-	this->connection.connect(
-		UPDATE_URL);
-	this->timer = SetTimer(nullptr, 0, 500, UpdateChecker::timerCb);
+UpdateChecker::UpdateChecker(bool manual, UINT delay): manual(manual) {
+	if (delay == 0) {
+		this->startWorker();
+	} else {
+		this->timer = SetTimer(nullptr, 0, delay, UpdateChecker::timerCb);
+	}
 }
 
 UpdateChecker::~UpdateChecker() {
 	this->killTimer();
+	this->cancelled = true;
+	if (this->worker.joinable()) {
+		this->worker.join();
+	}
 	UpdateChecker::instance = nullptr;
-	JNL::close_socketlib();
 }
 
-void UpdateChecker::tick() {
-	int res = this->connection.run();
-	if (res == -1) {
-		killTimer();
-		this->error();
-		cancelUpdateCheck();
-		return;
+void UpdateChecker::startWorker() {
+	this->killTimer();
+	// Keep track of the last time we checked for an update. We do this even for
+	// a manual check because the user probably doesn't want auto update checks
+	// soon if they've just done a manual check. This is done here rather than
+	// when the check is scheduled so that quitting during the startup delay
+	// doesn't skip the check.
+	SetExtState(CONFIG_SECTION, LAST_CHECK_KEY,
+		format("{}", time(nullptr)).c_str(), true);
+	std::string etag, lastModified;
+	// The validators are only useful if update.json was current for this
+	// version when they were stored.
+	if (std::string(GetExtState(CONFIG_SECTION, VALIDATOR_VERSION_KEY)) ==
+			OSARA_VERSION) {
+		etag = GetExtState(CONFIG_SECTION, ETAG_KEY);
+		lastModified = GetExtState(CONFIG_SECTION, LAST_MODIFIED_KEY);
 	}
-	if (res == 0) {
-		// Still waiting for the connection to close.
-		return;
+	this->worker = std::thread([this, etag, lastModified] {
+		this->result = UpdateChecker::fetch(etag, lastModified, this->cancelled);
+		this->isDone = true;
+	});
+	// We only check whether the worker has finished here. This doesn't do any
+	// I/O.
+	this->timer = SetTimer(nullptr, 0, 500, UpdateChecker::timerCb);
+}
+
+UpdateResult UpdateChecker::fetch(std::string etag, std::string lastModified,
+	const std::atomic<bool>& cancelled
+) {
+	UpdateResult result;
+	JNL::open_socketlib();
+	std::string data;
+	int replyCode = 0;
+	{
+		JNL_HTTPGet connection;
+		if (!etag.empty()) {
+			connection.addheader(("If-None-Match: " + etag).c_str());
+		}
+		if (!lastModified.empty()) {
+			connection.addheader(("If-Modified-Since: " + lastModified).c_str());
+		}
+		connection.connect(UPDATE_URL);
+		for (;;) {
+			int res = connection.run();
+			char buf[4096];
+			while (connection.bytes_available() > 0) {
+				int len = connection.get_bytes(buf, sizeof(buf));
+				if (len <= 0) {
+					break;
+				}
+				data.append(buf, len);
+			}
+			if (res == -1 || cancelled) {
+				JNL::close_socketlib();
+				return result;
+			}
+			if (res == 1) {
+				// The connection has closed, so we've received all the data.
+				break;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+		replyCode = connection.getreplycode();
+		if (const char* header = connection.getheader("etag")) {
+			result.etag = header;
+		}
+		if (const char* header = connection.getheader("last-modified")) {
+			result.lastModified = header;
+		}
 	}
-	if (!IsWindowEnabled(GetAncestor(GetForegroundWindow(), GA_ROOTOWNER))) {
-		// A modal dialog is open. We must not try to display a dialog until it is
-		// closed. Otherwise, our dialog will be somewhat unusable.
-		return;
+	JNL::close_socketlib();
+	if (replyCode == 304) {
+		result.status = UpdateResult::NOT_MODIFIED;
+		return result;
+	}
+	if (replyCode != 200) {
+		return result;
 	}
-	// The connection has closed, so we've received all the data.
-	this->killTimer();
-	char data[16384];
-	this->connection.get_bytes(data, sizeof(data));
 	std::string curVersion = OSARA_VERSION;
-	std::ostringstream s;
 	try {
 		json::jobject obj = json::jobject::parse(data);
-		if ((std::string)obj["version"] == curVersion) {
-			// We're running the latest version.
-			if (this->manual) {
-				MessageBox(GetForegroundWindow(), translate("No OSARA update available."),
-					translate_ctxt("OSARA Update", "OSARA Update"),
-					MB_ICONINFORMATION | MB_OK);
-			}
-			cancelUpdateCheck();
-			return;
+		result.version = (std::string)obj["version"];
+		if (result.version == curVersion) {
+			result.status = UpdateResult::CURRENT;
+			return result;
 		}
-		const char SEPARATOR[] = "\r\n\r\n";
-		s << format(translate("OSARA version {} is available. Changes:"),
-			(std::string)obj["version"]) << SEPARATOR;
 		auto pos = curVersion.find(",");
 		std::string curCommit = curVersion.substr(pos + 1);
 		auto commits = obj["commits"].as_object();
@@ -165,15 +272,57 @@ void UpdateChecker::tick() {
 				// from here.
 				break;
 			}
-			std::string message = commit.array(1);
-			s << message << SEPARATOR;
+			result.changes.push_back(commit.array(1));
 		}
+		result.status = UpdateResult::AVAILABLE;
 	} catch (...) {
 		// JSON error.
+		result.status = UpdateResult::ERROR_;
+	}
+	return result;
+}
+
+void UpdateChecker::tick() {
+	if (!this->isDone) {
+		return;
+	}
+	if (this->result.status == UpdateResult::ERROR_) {
+		this->killTimer();
 		this->error();
 		cancelUpdateCheck();
 		return;
 	}
+	if (!IsWindowEnabled(GetAncestor(GetForegroundWindow(), GA_ROOTOWNER))) {
+		// A modal dialog is open. We must not try to display a dialog until it is
+		// closed. Otherwise, our dialog will be somewhat unusable.
+		return;
+	}
+	this->killTimer();
+	if (this->result.status == UpdateResult::CURRENT) {
+		// Remember the validators so that subsequent checks don't need to fetch
+		// update.json again unless it changes.
+		SetExtState(CONFIG_SECTION, VALIDATOR_VERSION_KEY, OSARA_VERSION, true);
+		SetExtState(CONFIG_SECTION, ETAG_KEY, this->result.etag.c_str(), true);
+		SetExtState(CONFIG_SECTION, LAST_MODIFIED_KEY,
+			this->result.lastModified.c_str(), true);
+	}
+	if (this->result.status != UpdateResult::AVAILABLE) {
+		// We're running the latest version.
+		if (this->manual) {
+			MessageBox(GetForegroundWindow(), translate("No OSARA update available."),
+				translate_ctxt("OSARA Update", "OSARA Update"),
+				MB_ICONINFORMATION | MB_OK);
+		}
+		cancelUpdateCheck();
+		return;
+	}
+	std::ostringstream s;
+	const char SEPARATOR[] = "\r\n\r\n";
+	s << format(translate("OSARA version {} is available. Changes:"),
+		this->result.version) << SEPARATOR;
+	for (const std::string& message : this->result.changes) {
+		s << message << SEPARATOR;
+	}
 	// Tell the user about the update!
 	HWND dialog = CreateDialog(pluginHInstance, 
 		MAKEINTRESOURCE(ID_UPDATE_DLG), GetForegroundWindow(),